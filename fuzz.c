@@ -0,0 +1,485 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Differential test of every engine against a reference stable sort.
+ * Each input is sorted by each engine and the result must list exactly
+ * the nodes of the reference, in the same order, with consistent
+ * next/prev links; every comparator call must follow the list_sort()
+ * contract.
+ */
+#include "list.h"
+#include "list_sort.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+
+/* Random sizes are drawn below this */
+#define FUZZ_MAX_NODES 5000
+/* Largest k for the 2^k - 1, 2^k and 2^k + 1 sizes */
+#define FUZZ_MAX_ORDER 14
+/* Default number of random inputs after the fixed sizes */
+#define FUZZ_ITERATIONS 2000
+/* Failures reported in detail per engine */
+#define FUZZ_REPORT 3
+
+typedef struct element {
+	struct list_head list;
+	struct hlist_node hnode;	/* For the hlist_sort() adapter */
+	struct slist_node snode;	/* For the slist_sort() adapter */
+	int val;
+	int seq;
+} element_t;
+
+/*
+ * Comparator state, passed as priv.  The comparators check that they
+ * got it, that both nodes belong to the input and that @a came first
+ * in the input, as list_sort() promises.
+ */
+struct fuzz_priv {
+	element_t *space;
+	size_t n;
+	unsigned long calls, bad_calls, bad_order;
+	unsigned long bad_pprev;	/* Set by the hlist_sort() adapter */
+};
+
+static bool check_call(void *priv, const struct list_head *a,
+		       const struct list_head *b)
+{
+	struct fuzz_priv *p = priv;
+	const element_t *ea = list_entry(a, element_t, list);
+	const element_t *eb = list_entry(b, element_t, list);
+
+	p->calls++;
+	if (ea < p->space || ea >= p->space + p->n ||
+	    eb < p->space || eb >= p->space + p->n) {
+		p->bad_calls++;
+		return false;
+	}
+	if (ea->seq > eb->seq)
+		p->bad_order++;
+	return true;
+}
+
+/* The traditional <0 / =0 / >0 style */
+static int compare_int(void *priv, const struct list_head *a,
+		       const struct list_head *b)
+{
+	int va = list_entry(a, element_t, list)->val;
+	int vb = list_entry(b, element_t, list)->val;
+
+	check_call(priv, a, b);
+	return va < vb ? -1 : va > vb;
+}
+
+/* The boolean style, as used by plug_ctx_cmp() */
+static int compare_bool(void *priv, const struct list_head *a,
+			const struct list_head *b)
+{
+	check_call(priv, a, b);
+	return list_entry(a, element_t, list)->val >
+	       list_entry(b, element_t, list)->val;
+}
+
+static const struct {
+	const char *name;
+	list_cmp_func_t cmp;
+} comparators[] = {
+	{ "int", compare_int },
+	{ "bool", compare_bool },
+};
+
+static void parallel_sort2(void *priv, struct list_head *head,
+			   list_cmp_func_t cmp)
+{
+	list_sort_parallel(priv, head, cmp, 2);
+}
+
+static void parallel_sort4(void *priv, struct list_head *head,
+			   list_cmp_func_t cmp)
+{
+	list_sort_parallel(priv, head, cmp, 4);
+}
+
+/* Far enough ahead that the lookahead runs past short runs and lists */
+static void prefetch_sort(void *priv, struct list_head *head,
+			  list_cmp_func_t cmp)
+{
+	timsort_prefetch(priv, head, cmp,
+			 offsetof(element_t, val) - offsetof(element_t, list), 8);
+}
+
+/* timsort_key() orders by val directly and never calls @cmp */
+static void key_sort(void *priv, struct list_head *head, list_cmp_func_t cmp)
+{
+	timsort_key(head, offsetof(element_t, val) - offsetof(element_t, list));
+}
+
+/* The list_head comparator, called from the hlist and slist adapters */
+struct wrapped_cmp {
+	void *priv;
+	list_cmp_func_t cmp;
+};
+
+static int hlist_compare(void *priv, const struct hlist_node *a,
+			 const struct hlist_node *b)
+{
+	struct wrapped_cmp *w = priv;
+
+	return w->cmp(w->priv, &hlist_entry(a, element_t, hnode)->list,
+		      &hlist_entry(b, element_t, hnode)->list);
+}
+
+static int slist_compare(void *priv, const struct slist_node *a,
+			 const struct slist_node *b)
+{
+	struct wrapped_cmp *w = priv;
+
+	return w->cmp(w->priv, &container_of(a, element_t, snode)->list,
+		      &container_of(b, element_t, snode)->list);
+}
+
+/*
+ * Copy the list order to an hlist, sort that, check every pprev and
+ * copy the order back for check_sorted().
+ */
+static void hlist_adapter(void *priv, struct list_head *head,
+			  list_cmp_func_t cmp)
+{
+	struct wrapped_cmp w = { priv, cmp };
+	struct hlist_node **tail, *node;
+	struct hlist_head hhead;
+	element_t *entry;
+
+	tail = &hhead.first;
+	list_for_each_entry(entry, head, list) {
+		*tail = &entry->hnode;
+		entry->hnode.pprev = tail;
+		tail = &entry->hnode.next;
+	}
+	*tail = NULL;
+
+	hlist_sort(&w, &hhead, hlist_compare);
+
+	INIT_LIST_HEAD(head);
+	for (tail = &hhead.first; (node = *tail); tail = &node->next) {
+		if (node->pprev != tail)
+			((struct fuzz_priv *)priv)->bad_pprev++;
+		list_add_tail(&hlist_entry(node, element_t, hnode)->list, head);
+	}
+}
+
+static void slist_adapter(void *priv, struct list_head *head,
+			  list_cmp_func_t cmp)
+{
+	struct wrapped_cmp w = { priv, cmp };
+	struct slist_node *list = NULL, **tail = &list;
+	element_t *entry;
+
+	list_for_each_entry(entry, head, list) {
+		*tail = &entry->snode;
+		tail = &entry->snode.next;
+	}
+	*tail = NULL;
+
+	list = slist_sort(&w, list, slist_compare);
+
+	INIT_LIST_HEAD(head);
+	for (; list; list = list->next)
+		list_add_tail(&container_of(list, element_t, snode)->list, head);
+}
+
+static const struct engine {
+	const char *name;
+	list_sort_func_t sort;
+	bool any_order;		/* Documented to call @cmp either way round */
+	bool unstable;		/* Equal keys may come out in any order */
+} engines[] = {
+	{ "list_sort", list_sort },
+	{ "list_sort_old", list_sort_old },
+	{ "list_sort_runs", list_sort_runs },
+	{ "list_sort_4way", list_sort_4way },
+	{ "list_sort_net", list_sort_net },
+	{ "list_sort_lowcard", list_sort_lowcard, true },
+	{ "list_sort_unstable", list_sort_unstable, true, true },
+	{ "list_sort_cache", list_sort_cache },
+	{ "list_sort_small", list_sort_small },
+	{ "list_sort_auto", list_sort_auto },
+	{ "list_sort_parallel/2", parallel_sort2 },
+	{ "list_sort_parallel/4", parallel_sort4 },
+	{ "shiverssort", shiverssort },
+	{ "timsort", timsort },
+	{ "timsort_prefetch", prefetch_sort },
+	{ "timsort_key", key_sort },
+	{ "hlist_sort", hlist_adapter },
+	{ "slist_sort", slist_adapter },
+	{ NULL, NULL },
+};
+
+/*
+ * Input shapes.  Besides random keys these are the cases run detection
+ * and the merge schedule are most likely to get wrong: equal keys (a
+ * descending run must be strict, or reversing it breaks stability),
+ * alternating directions, runs that end exactly on or next to the
+ * block and level boundaries, and very few distinct keys.
+ */
+enum pattern {
+	PAT_RANDOM,
+	PAT_FEW_KEYS,		/* random keys from 0..3 */
+	PAT_EQUAL,
+	PAT_SORTED,
+	PAT_REVERSED,
+	PAT_REVERSED_DUPS,	/* descending, each key twice */
+	PAT_ORGAN_PIPE,
+	PAT_SAWTOOTH,		/* ascending runs of random length */
+	PAT_STAIRS,		/* ascending runs, each below the one before */
+	PAT_ZIGZAG,		/* alternating ascending/descending pairs */
+	PAT_RUNS_POW2,		/* ascending runs of 2^k nodes */
+	PAT_NOISY,		/* sorted with 1 in 16 keys replaced */
+	NR_PATTERNS,
+};
+
+static const char *pattern_names[NR_PATTERNS] = {
+	[PAT_RANDOM] = "random",
+	[PAT_FEW_KEYS] = "few-keys",
+	[PAT_EQUAL] = "equal",
+	[PAT_SORTED] = "sorted",
+	[PAT_REVERSED] = "reversed",
+	[PAT_REVERSED_DUPS] = "reversed-dups",
+	[PAT_ORGAN_PIPE] = "organ-pipe",
+	[PAT_SAWTOOTH] = "sawtooth",
+	[PAT_STAIRS] = "stairs",
+	[PAT_ZIGZAG] = "zigzag",
+	[PAT_RUNS_POW2] = "runs-pow2",
+	[PAT_NOISY] = "noisy",
+};
+
+static void gen_keys(int *keys, size_t n, enum pattern pattern)
+{
+	size_t run = 1 + rand() % 64, pow2 = (size_t)1 << (rand() % 8);
+
+	for (size_t i = 0; i < n; i++) {
+		switch (pattern) {
+		case PAT_RANDOM:
+			keys[i] = rand() - RAND_MAX / 2;
+			break;
+		case PAT_FEW_KEYS:
+			keys[i] = rand() % 4;
+			break;
+		case PAT_EQUAL:
+			keys[i] = 7;
+			break;
+		case PAT_SORTED:
+			keys[i] = i;
+			break;
+		case PAT_REVERSED:
+			keys[i] = n - i;
+			break;
+		case PAT_REVERSED_DUPS:
+			keys[i] = (n - i) / 2;
+			break;
+		case PAT_ORGAN_PIPE:
+			keys[i] = i < n / 2 ? i : n - i;
+			break;
+		case PAT_SAWTOOTH:
+			keys[i] = i % run;
+			break;
+		case PAT_STAIRS:
+			/* Half a sample window, half its pairs inverted */
+			keys[i] = i % (LIST_SORT_SAMPLE_WINDOW / 2) -
+				  i / (LIST_SORT_SAMPLE_WINDOW / 2) *
+				  LIST_SORT_SAMPLE_WINDOW;
+			break;
+		case PAT_ZIGZAG:
+			keys[i] = i & 1 ? i - 1 : i + 1;
+			break;
+		case PAT_RUNS_POW2:
+			keys[i] = (i % pow2) * 2 + (i / pow2) % 2;
+			break;
+		case PAT_NOISY:
+			keys[i] = rand() % 16 ? (int)i : rand() % (int)n;
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+static int cmp_ref(const void *a, const void *b)
+{
+	const element_t *x = *(element_t *const *)a, *y = *(element_t *const *)b;
+
+	if (x->val != y->val)
+		return x->val < y->val ? -1 : 1;
+	return x->seq - y->seq;
+}
+
+/*
+ * Check @head against the reference order @ref.  Comparing node
+ * identities position by position checks that the output is a
+ * permutation of the input and that equal keys kept their order.
+ * Unless @stable, only the keys are compared, and seq is flipped
+ * negative on the way to catch a node listed twice.
+ * Returns NULL or a description of the first problem.
+ */
+static const char *check_sorted(struct list_head *head, element_t **ref,
+				size_t n, bool stable)
+{
+	struct list_head *pos = head;
+
+	for (size_t i = 0; i < n; i++) {
+		element_t *entry;
+
+		if (pos->next->prev != pos)
+			return "next->prev does not point back";
+		pos = pos->next;
+		if (pos == head)
+			return "too few nodes";
+		entry = list_entry(pos, element_t, list);
+		if (!stable) {
+			if (entry->val != ref[i]->val)
+				return "not sorted";
+			if (entry->seq < 0)
+				return "not a permutation";
+			entry->seq = -1 - entry->seq;
+			continue;
+		}
+		if (pos != &ref[i]->list)
+			return entry->val != ref[i]->val ?
+			       "not sorted or not a permutation" :
+			       "not stable";
+	}
+	if (pos->next != head)
+		return "too many nodes";
+	if (head->prev != pos)
+		return "head->prev is not the last node";
+	return NULL;
+}
+
+static unsigned long failures[sizeof(engines) / sizeof(engines[0])];
+
+static void fail(size_t e, const char *cmp, enum pattern pattern, size_t n,
+		 const char *what)
+{
+	if (failures[e]++ < FUZZ_REPORT) {
+		printf("FAIL %s: %s comparator, %s, %zu nodes: %s\n",
+		       engines[e].name, cmp, pattern_names[pattern], n, what);
+		/* Keep the report if a later engine crashes */
+		fflush(stdout);
+	}
+}
+
+/* Sort one input with every engine and both comparator styles */
+static void fuzz_one(element_t *space, element_t **ref, int *keys, size_t n,
+		     enum pattern pattern)
+{
+	struct list_head head;
+
+	gen_keys(keys, n, pattern);
+	for (size_t i = 0; i < n; i++) {
+		space[i].val = keys[i];
+		space[i].seq = i;
+		ref[i] = &space[i];
+	}
+	qsort(ref, n, sizeof(*ref), cmp_ref);
+
+	for (size_t e = 0; engines[e].name; e++) {
+		for (size_t c = 0; c < sizeof(comparators) / sizeof(comparators[0]);
+		     c++) {
+			struct fuzz_priv priv = { .space = space, .n = n };
+			const char *what;
+
+			INIT_LIST_HEAD(&head);
+			for (size_t i = 0; i < n; i++) {
+				space[i].val = keys[i];
+				space[i].seq = i;
+				list_add_tail(&space[i].list, &head);
+			}
+			engines[e].sort(&priv, &head, comparators[c].cmp);
+
+			what = check_sorted(&head, ref, n, !engines[e].unstable);
+			if (!what && priv.bad_calls)
+				what = "cmp called on a foreign node";
+			if (!what && priv.bad_order && !engines[e].any_order)
+				what = "cmp called with the later node as a";
+			if (!what && priv.bad_pprev)
+				what = "pprev does not point back";
+			if (what)
+				fail(e, comparators[c].name, pattern, n, what);
+		}
+	}
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [-i iterations] [-s seed]\n"
+		"  -i iterations  random inputs after the fixed sizes (default %d)\n"
+		"  -s seed        random seed (default 1050)\n",
+		prog, FUZZ_ITERATIONS);
+}
+
+int main(int argc, char *argv[])
+{
+	size_t max = ((size_t)1 << FUZZ_MAX_ORDER) + 1, inputs = 0;
+	unsigned long iterations = FUZZ_ITERATIONS, total = 0;
+	unsigned int seed = 1050;
+	element_t *space, **ref;
+	int *keys, opt;
+
+	while ((opt = getopt(argc, argv, "i:s:")) != -1) {
+		switch (opt) {
+		case 'i':
+			iterations = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			seed = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (max < LIST_SORT_AUTO_MIN + 1)
+		max = LIST_SORT_AUTO_MIN + 1;
+
+	srand(seed);
+	space = malloc(sizeof(*space) * max);
+	ref = malloc(sizeof(*ref) * max);
+	keys = malloc(sizeof(*keys) * max);
+
+	/* 0, 1, 2, 3 and 2^k - 1, 2^k, 2^k + 1 nodes, in every pattern */
+	for (size_t n = 0; n < 4; n++)
+		for (enum pattern p = 0; p < NR_PATTERNS; p++, inputs++)
+			fuzz_one(space, ref, keys, n, p);
+	for (int k = 2; k <= FUZZ_MAX_ORDER; k++)
+		for (size_t n = ((size_t)1 << k) - 1; n <= ((size_t)1 << k) + 1; n++)
+			for (enum pattern p = 0; p < NR_PATTERNS; p++, inputs++)
+				fuzz_one(space, ref, keys, n, p);
+	/*
+	 * Either side of the size from which list_sort_auto() samples the
+	 * list and dispatches on it; the patterns reach every engine in
+	 * its table.
+	 */
+	for (size_t n = LIST_SORT_AUTO_MIN - 1; n <= LIST_SORT_AUTO_MIN + 1; n++)
+		for (enum pattern p = 0; p < NR_PATTERNS; p++, inputs++)
+			fuzz_one(space, ref, keys, n, p);
+
+	for (unsigned long i = 0; i < iterations; i++, inputs++)
+		fuzz_one(space, ref, keys, rand() % FUZZ_MAX_NODES,
+			 rand() % NR_PATTERNS);
+
+	for (size_t e = 0; engines[e].name; e++) {
+		printf("%-22s %s\n", engines[e].name,
+		       failures[e] ? "FAILED" : "ok");
+		total += failures[e];
+	}
+	printf("%zu inputs, %lu failures (seed %u)\n", inputs, total, seed);
+
+	free(keys);
+	free(ref);
+	free(space);
+	return total ? 1 : 0;
+}
@@ -0,0 +1,143 @@
+// SPDX-License-Identifier: GPL-2.0
+#include "list.h"
+#include "list_sort.h"
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef likely
+# define likely(x)	__builtin_expect(!!(x), 1)
+#endif
+#ifndef unlikely
+# define unlikely(x)	__builtin_expect(!!(x), 0)
+#endif
+
+/* At most two pending sublists per size */
+#define MAX_MERGE_PENDING (2 * sizeof(size_t) * 8)
+
+/*
+ * Returns a null-terminated list; "pprev" links are not maintained
+ * until merge_final().
+ */
+static struct hlist_node *merge(void *priv, hlist_cmp_func_t cmp,
+				struct hlist_node *a, struct hlist_node *b)
+{
+	struct hlist_node *head, **tail = &head;
+
+	for (;;) {
+		/* if equal, take 'a' -- important for sort stability */
+		if (cmp(priv, a, b) <= 0) {
+			*tail = a;
+			tail = &a->next;
+			a = a->next;
+			if (!a) {
+				*tail = b;
+				break;
+			}
+		} else {
+			*tail = b;
+			tail = &b->next;
+			b = b->next;
+			if (!b) {
+				*tail = a;
+				break;
+			}
+		}
+	}
+	return head;
+}
+
+/*
+ * The last merge, linking the result to @head and setting every pprev
+ * on the way, so no separate fixup pass is needed.
+ */
+static void merge_final(void *priv, hlist_cmp_func_t cmp,
+			struct hlist_head *head, struct hlist_node *a,
+			struct hlist_node *b)
+{
+	struct hlist_node **tail = &head->first;
+
+	for (;;) {
+		/* if equal, take 'a' -- important for sort stability */
+		if (cmp(priv, a, b) <= 0) {
+			*tail = a;
+			a->pprev = tail;
+			tail = &a->next;
+			a = a->next;
+			if (!a)
+				break;
+		} else {
+			*tail = b;
+			b->pprev = tail;
+			tail = &b->next;
+			b = b->next;
+			if (!b) {
+				b = a;
+				break;
+			}
+		}
+	}
+
+	/* Finish linking remainder of list b on to tail */
+	*tail = b;
+	do {
+		b->pprev = tail;
+		tail = &b->next;
+		b = b->next;
+	} while (b);
+}
+
+/**
+ * hlist_sort - sort a hash list
+ * @priv: private data, opaque to hlist_sort(), passed to @cmp
+ * @head: the list to sort
+ * @cmp: the elements comparison function
+ *
+ * Sorts the hlist in place; it stays null-terminated, with every pprev
+ * valid.  @cmp follows the list_sort() contract, and the sort is stable.
+ *
+ * This is slist_sort() on the next pointers, with the pending sublists
+ * on a stack, except that the last merge also sets the pprev pointers,
+ * as merge_final() does for prev in list_sort(), instead of a separate
+ * fixup pass.  pprev is not touched before that merge, so a node is
+ * never seen as unhashed while the sort runs.
+ */
+void hlist_sort(void *priv, struct hlist_head *head, hlist_cmp_func_t cmp)
+{
+	struct hlist_node *list = head->first;
+	struct hlist_node *pending[MAX_MERGE_PENDING];
+	size_t count = 0;	/* Count of pending */
+	int top = 0;		/* pending[top - 1] is the newest */
+
+	if (!list || !list->next)	/* Zero or one elements */
+		return;
+
+	do {
+		size_t bits;
+		int at = top - 1;
+
+		/* Find the least-significant clear bit in count */
+		for (bits = count; bits & 1; bits >>= 1)
+			at--;
+		/* Do the indicated merge */
+		if (likely(bits)) {
+			pending[at - 1] = merge(priv, cmp, pending[at - 1],
+						pending[at]);
+			for (top--; at < top; at++)
+				pending[at] = pending[at + 1];
+		}
+
+		/* Move one element from input list to pending */
+		pending[top++] = list;
+		list = list->next;
+		pending[top - 1]->next = NULL;
+		count++;
+	} while (list);
+
+	/* End of input; merge together all the pending lists. */
+	list = pending[--top];
+	while (top > 1)
+		list = merge(priv, cmp, pending[--top], list);
+	/* The final merge, rebuilding pprev links */
+	merge_final(priv, cmp, head, pending[0], list);
+}
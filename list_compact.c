@@ -0,0 +1,44 @@
+// SPDX-License-Identifier: GPL-2.0
+#include "list.h"
+#include "list_sort.h"
+
+#include <string.h>
+
+/**
+ * list_sort_compact - move list elements into an arena in list order
+ * @head: the list to compact, usually right after it was sorted
+ * @elem_size: size in bytes of the structure embedding each node
+ * @member_offset: offset of the struct list_head inside that structure
+ * @arena: destination, at least (number of nodes * @elem_size) bytes
+ *
+ * After a sort the nodes are linked in order, but their addresses are
+ * still in allocation order, so every later traversal is a pointer
+ * chase across the heap.  This copies each element into @arena in list
+ * order and relinks the copies, so that walking @head afterwards is a
+ * sequential stream through memory.
+ *
+ * The old element storage is left untouched and no longer linked from
+ * @head; any outside pointer into it is stale.  @arena must not overlap
+ * the elements being moved.
+ */
+void list_sort_compact(struct list_head *head, size_t elem_size,
+		       size_t member_offset, void *arena)
+{
+	struct list_head *pos = head->next, *tail = head;
+	char *dst = arena;
+
+	while (pos != head) {
+		struct list_head *node = (struct list_head *)(dst + member_offset);
+
+		memcpy(dst, (char *)pos - member_offset, elem_size);
+		pos = pos->next;
+
+		tail->next = node;
+		node->prev = tail;
+		tail = node;
+		dst += elem_size;
+	}
+
+	tail->next = head;
+	head->prev = tail;
+}
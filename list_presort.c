@@ -0,0 +1,105 @@
+// SPDX-License-Identifier: GPL-2.0
+#include "list.h"
+#include "list_sort.h"
+
+#include <math.h>
+#include <string.h>
+
+/* Nodes picked at an even stride to estimate the inversion count */
+#define INVERSION_SAMPLES 1024
+
+/* Add the contribution of a run of @len nodes to the entropy sum */
+static void account_run(struct list_presortedness *p, size_t len)
+{
+	p->runs++;
+	p->nh += len * log2(len);
+}
+
+/*
+ * Split the list into maximal runs the way find_run() does: a run is
+ * either non-descending or strictly descending.  Returns the number of
+ * nodes; p->nh temporarily holds sum(len * log2(len)).
+ */
+static size_t count_runs(void *priv, struct list_head *head,
+			 list_cmp_func_t cmp, struct list_presortedness *p)
+{
+	struct list_head *pos = head->next;
+	size_t nodes = 0;
+
+	while (pos != head) {
+		struct list_head *next = pos->next;
+		size_t len = 1;
+
+		if (next != head) {
+			bool descending = cmp(priv, pos, next) > 0;
+
+			do {
+				len++;
+				pos = next;
+				next = pos->next;
+			} while (next != head &&
+				 (cmp(priv, pos, next) > 0) == descending);
+		}
+		account_run(p, len);
+		nodes += len;
+		pos = next;
+	}
+	return nodes;
+}
+
+/*
+ * Count the inversions among up to INVERSION_SAMPLES nodes taken at an
+ * even stride and scale the rate up to all n(n-1)/2 pairs.  The result
+ * is exact for lists of at most INVERSION_SAMPLES nodes.
+ */
+static double estimate_inversions(void *priv, struct list_head *head,
+				  list_cmp_func_t cmp, size_t nodes)
+{
+	struct list_head *sample[INVERSION_SAMPLES], *pos = head->next;
+	size_t m = nodes < INVERSION_SAMPLES ? nodes : INVERSION_SAMPLES;
+	size_t inversions = 0;
+
+	if (m < 2)
+		return 0;
+
+	for (size_t i = 0, j = 0; j < m; i++, pos = pos->next)
+		if (i == j * nodes / m)
+			sample[j++] = pos;
+
+	for (size_t i = 0; i < m - 1; i++)
+		for (size_t j = i + 1; j < m; j++)
+			inversions += cmp(priv, sample[i], sample[j]) > 0;
+
+	return (double)inversions * nodes * (nodes - 1) / (m * (m - 1));
+}
+
+/**
+ * list_presortedness - measure how sorted a list already is
+ * @priv: private data, passed to @cmp
+ * @head: the list to measure; it is not modified
+ * @cmp: the elements comparison function, as for list_sort()
+ * @p: where to store the results
+ *
+ * Finds the runs the merge engines would start from and their length
+ * entropy H = -sum((len/n) * log2(len/n)), estimates the inversions, and
+ * derives two lower bounds on the comparisons any sort needs: log2(n!)
+ * for arbitrary input, and n*H for merging the existing runs.
+ *
+ * This walks the list twice and costs about n + INVERSION_SAMPLES^2 / 2
+ * comparisons.
+ */
+void list_presortedness(void *priv, struct list_head *head,
+			list_cmp_func_t cmp, struct list_presortedness *p)
+{
+	memset(p, 0, sizeof(*p));
+
+	p->nodes = count_runs(priv, head, cmp, p);
+	if (!p->nodes)
+		return;
+
+	/* n*H = n*log2(n) - sum(len * log2(len)) */
+	p->nh = p->nodes * log2(p->nodes) - p->nh;
+	p->entropy = p->nh / p->nodes;
+	p->inversions = estimate_inversions(priv, head, cmp, p->nodes);
+	p->lg_nfact = lgamma(p->nodes + 1.0) / M_LN2;
+}
@@ -1,6 +1,7 @@
 // SPDX-License-Identifier: GPL-2.0
 #include "list.h"
 #include "list_sort.h"
+#include "list_sort_trace.h"
 
 #include <stdint.h>
 #include <stddef.h>
@@ -188,10 +189,13 @@ void list_sort(void *priv, struct list_head *head, list_cmp_func_t cmp)
 {
 	struct list_head *list = head->next, *pending = NULL;
 	size_t count = 0;	/* Count of pending */
+	size_t half;		/* For the merge probes, see below */
 
 	if (list == head->prev)	/* Zero or one elements */
 		return;
 
+	LIST_SORT_PROBE1(list_sort, entry, head);
+
 	/* Convert to a null-terminated singly-linked list. */
 	head->prev->next = NULL;
 
@@ -224,6 +228,9 @@ void list_sort(void *priv, struct list_head *head, list_cmp_func_t cmp)
 		if (likely(bits)) {
 			struct list_head *a = *tail, *b = a->prev;
 
+			/* Both are 2^k, k being the number of bits skipped */
+			LIST_SORT_PROBE2(list_sort, merge, ~count & (count + 1),
+					 ~count & (count + 1));
 			a = merge(priv, cmp, b, a);
 			/* Install the merged result in place of the inputs */
 			a->prev = b->prev;
@@ -238,17 +245,29 @@ void list_sort(void *priv, struct list_head *head, list_cmp_func_t cmp)
 		count++;
 	} while (list);
 
-	/* End of input; merge together all the pending lists. */
+	/*
+	 * End of input; merge together all the pending lists.  For the
+	 * probes: with half = 2^(i-1), the i-th pending list from the
+	 * front (i >= 1) holds half elements, or twice that if bit i-1 of
+	 * count is set, and the lists in front of it half + count % half.
+	 */
 	list = pending;
 	pending = pending->prev;
+	half = 1;
 	for (;;) {
 		struct list_head *next = pending->prev;
 
 		if (!next)
 			break;
+		LIST_SORT_PROBE2(list_sort, merge, half + (count & half),
+				 half + (count & (half - 1)));
 		list = merge(priv, cmp, pending, list);
 		pending = next;
+		half <<= 1;
 	}
 	/* The final merge, rebuilding prev links */
+	LIST_SORT_PROBE2(list_sort, merge, half + (count & half),
+			 half + (count & (half - 1)));
 	merge_final(priv, cmp, head, pending, list);
+	LIST_SORT_PROBE2(list_sort, exit, head, count);
 }
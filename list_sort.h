@@ -1,12 +1,80 @@
 /* SPDX-License-Identifier: GPL-2.0 */
 #pragma once
 
+#include <stdbool.h>
+#include <stddef.h>
+
 struct list_head;
+struct hlist_head;
+struct hlist_node;
+
+/* A plain singly-linked, null-terminated list node, for slist_sort() */
+struct slist_node {
+	struct slist_node *next;
+};
 
 typedef int (*list_cmp_func_t)(void *,
 		const struct list_head *, const struct list_head *);
+typedef int (*hlist_cmp_func_t)(void *,
+		const struct hlist_node *, const struct hlist_node *);
+typedef int (*slist_cmp_func_t)(void *,
+		const struct slist_node *, const struct slist_node *);
+
+typedef void (*list_sort_func_t)(void *priv, struct list_head *head,
+				 list_cmp_func_t cmp);
 
 void list_sort(void *priv, struct list_head *head, list_cmp_func_t cmp);
 void shiverssort(void *priv, struct list_head *head, list_cmp_func_t cmp);
 void timsort(void *priv, struct list_head *head, list_cmp_func_t cmp);
 void list_sort_old(void *priv, struct list_head *head, list_cmp_func_t cmp);
+void list_sort_runs(void *priv, struct list_head *head, list_cmp_func_t cmp);
+void list_sort_4way(void *priv, struct list_head *head, list_cmp_func_t cmp);
+void list_sort_net(void *priv, struct list_head *head, list_cmp_func_t cmp);
+void list_sort_lowcard(void *priv, struct list_head *head, list_cmp_func_t cmp);
+void list_sort_unstable(void *priv, struct list_head *head,
+			list_cmp_func_t cmp);
+void list_sort_cache(void *priv, struct list_head *head, list_cmp_func_t cmp);
+void list_sort_small(void *priv, struct list_head *head, list_cmp_func_t cmp);
+void timsort_key(struct list_head *head, ptrdiff_t key_offset);
+void timsort_prefetch(void *priv, struct list_head *head, list_cmp_func_t cmp,
+		      ptrdiff_t key_offset, int distance);
+void list_sort_parallel(void *priv, struct list_head *head, list_cmp_func_t cmp,
+			int threads);
+void hlist_sort(void *priv, struct hlist_head *head, hlist_cmp_func_t cmp);
+struct slist_node *slist_sort(void *priv, struct slist_node *list,
+			      slist_cmp_func_t cmp);
+
+void list_sort_compact(struct list_head *head, size_t elem_size,
+		       size_t member_offset, void *arena);
+
+/* Nodes compared at each end of the list by list_sort_sample() */
+#define LIST_SORT_SAMPLE_WINDOW		64
+/* Buckets per axis of the list_sort_auto() dispatch table */
+#define LIST_SORT_AUTO_BUCKETS		4
+/* Shorter lists are not sampled; list_sort_auto() hands them to list_sort() */
+#define LIST_SORT_AUTO_MIN		32768
+
+struct list_sort_sample {
+	unsigned int pairs;		/* Adjacent pairs compared */
+	unsigned int descents;		/* Adjacent pairs out of order */
+	unsigned int inversion_pairs;	/* All pairs compared */
+	unsigned int inversions;	/* All pairs out of order */
+	unsigned int run_bucket;	/* descents scaled to the table */
+	unsigned int inv_bucket;	/* inversions scaled to the table */
+};
+
+bool list_sort_sample(void *priv, struct list_head *head, list_cmp_func_t cmp,
+		      struct list_sort_sample *sample);
+void list_sort_auto(void *priv, struct list_head *head, list_cmp_func_t cmp);
+
+struct list_presortedness {
+	size_t nodes;
+	size_t runs;		/* Maximal runs, as find_run() splits them */
+	double entropy;		/* Run-length entropy H, in bits */
+	double inversions;	/* Estimated number of inversions */
+	double lg_nfact;	/* log2(n!), the comparison lower bound */
+	double nh;		/* n*H, the lower bound for merging the runs */
+};
+
+void list_presortedness(void *priv, struct list_head *head,
+			list_cmp_func_t cmp, struct list_presortedness *p);
@@ -0,0 +1,199 @@
+// SPDX-License-Identifier: GPL-2.0
+#include "list.h"
+#include "list_sort.h"
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef likely
+# define likely(x)	__builtin_expect(!!(x), 1)
+#endif
+#ifndef unlikely
+# define unlikely(x)	__builtin_expect(!!(x), 0)
+#endif
+
+static struct list_head *merge(void *priv, list_cmp_func_t cmp,
+				struct list_head *a, struct list_head *b)
+{
+	struct list_head *head, **tail = &head;
+
+	for (;;) {
+		/* if equal, take 'a' -- important for sort stability */
+		if (cmp(priv, a, b) <= 0) {
+			*tail = a;
+			tail = &a->next;
+			a = a->next;
+			if (!a) {
+				*tail = b;
+				break;
+			}
+		} else {
+			*tail = b;
+			tail = &b->next;
+			b = b->next;
+			if (!b) {
+				*tail = a;
+				break;
+			}
+		}
+	}
+	return head;
+}
+
+static void build_prev_link(struct list_head *head, struct list_head *tail,
+			    struct list_head *list)
+{
+	tail->next = list;
+	do {
+		list->prev = tail;
+		tail = list;
+		list = list->next;
+	} while (list);
+
+	/* The final links to make a circular doubly-linked list */
+	tail->next = head;
+	head->prev = tail;
+}
+
+static void merge_final(void *priv, list_cmp_func_t cmp, struct list_head *head,
+			struct list_head *a, struct list_head *b)
+{
+	struct list_head *tail = head;
+
+	for (;;) {
+		/* if equal, take 'a' -- important for sort stability */
+		if (cmp(priv, a, b) <= 0) {
+			tail->next = a;
+			a->prev = tail;
+			tail = a;
+			a = a->next;
+			if (!a)
+				break;
+		} else {
+			tail->next = b;
+			b->prev = tail;
+			tail = b;
+			b = b->next;
+			if (!b) {
+				b = a;
+				break;
+			}
+		}
+	}
+
+	/* Finish linking remainder of list b on to tail */
+	build_prev_link(head, tail, b);
+}
+
+/*
+ * Merge four sorted lists in one pass, @a..@d being in input order.
+ * The winners of (a, b) and (c, d) are cached, so taking a node costs
+ * one comparison against its sibling plus one at the root: the same two
+ * comparisons per node as two levels of merge(), but every node is read
+ * and relinked once instead of twice.
+ *
+ * Ties go to the earlier list at both levels, which keeps the merge
+ * stable.  Once a list runs dry the remaining three are finished off
+ * with merge(); for similar-sized inputs only a few nodes are left.
+ */
+static struct list_head *merge4(void *priv, list_cmp_func_t cmp,
+				struct list_head *a, struct list_head *b,
+				struct list_head *c, struct list_head *d)
+{
+	struct list_head *head, **tail = &head;
+	struct list_head **x, **y, **win;
+
+	x = cmp(priv, a, b) <= 0 ? &a : &b;
+	y = cmp(priv, c, d) <= 0 ? &c : &d;
+
+	for (;;) {
+		win = cmp(priv, *x, *y) <= 0 ? x : y;
+		*tail = *win;
+		tail = &(*win)->next;
+		*win = (*win)->next;
+		if (unlikely(!*win))
+			break;
+		if (win == &a || win == &b)
+			x = cmp(priv, a, b) <= 0 ? &a : &b;
+		else
+			y = cmp(priv, c, d) <= 0 ? &c : &d;
+	}
+
+	/* Finish the remaining three lists, keeping them in input order */
+	if (!a)
+		*tail = merge(priv, cmp, b, merge(priv, cmp, c, d));
+	else if (!b)
+		*tail = merge(priv, cmp, a, merge(priv, cmp, c, d));
+	else if (!c)
+		*tail = merge(priv, cmp, merge(priv, cmp, a, b), d);
+	else
+		*tail = merge(priv, cmp, merge(priv, cmp, a, b), c);
+	return head;
+}
+
+/**
+ * list_sort_4way - sort a list with a bottom-up four-way merge sort
+ * @priv: private data, opaque to list_sort_4way(), passed to @cmp
+ * @head: the list to sort
+ * @cmp: the elements comparison function
+ *
+ * Same contract as list_sort().  Pending sublists are merged four at a
+ * time, driven by the base-4 digits of "count": each time count reaches
+ * a multiple of 4^(k+1), the four newest sublists of size 4^k become one.
+ * Each node is therefore relinked about log4(n) times rather than
+ * log2(n) times, which halves the memory traffic once the list no
+ * longer fits in the last-level cache.
+ *
+ * Unlike list_sort() the merges are fully eager, so the final merges of
+ * the leftover pending lists may be up to 3:1 unbalanced.
+ */
+void list_sort_4way(void *priv, struct list_head *head, list_cmp_func_t cmp)
+{
+	struct list_head *list = head->next, *pending = NULL;
+	size_t count = 0;	/* Count of pending */
+
+	if (list == head->prev)	/* Zero or one elements */
+		return;
+
+	/* Convert to a null-terminated singly-linked list. */
+	head->prev->next = NULL;
+
+	do {
+		size_t bits;
+
+		/* Move one element from input list to pending */
+		list->prev = pending;
+		pending = list;
+		list = list->next;
+		pending->next = NULL;
+		count++;
+
+		/* Merge four sublists for every trailing zero base-4 digit */
+		for (bits = count; !(bits & 3); bits >>= 2) {
+			struct list_head *d = pending, *c = d->prev;
+			struct list_head *b = c->prev, *a = b->prev;
+			struct list_head *prev = a->prev;
+
+			pending = merge4(priv, cmp, a, b, c, d);
+			pending->prev = prev;
+		}
+	} while (list);
+
+	/* End of input; merge together all the pending lists. */
+	list = pending;
+	pending = pending->prev;
+	if (!pending) {
+		build_prev_link(head, head, list);
+		return;
+	}
+	for (;;) {
+		struct list_head *next = pending->prev;
+
+		if (!next)
+			break;
+		list = merge(priv, cmp, pending, list);
+		pending = next;
+	}
+	/* The final merge, rebuilding prev links */
+	merge_final(priv, cmp, head, pending, list);
+}
@@ -0,0 +1,142 @@
+// SPDX-License-Identifier: GPL-2.0
+#include "list.h"
+#include "list_sort.h"
+#include "list_sort_auto_table.h"
+
+#include <string.h>
+
+/*
+ * Merge sort the @n node pointers at @a, using @tmp, and return the
+ * number of inversions among them.  Every node of the left half came
+ * before every node of the right half in the list, so @cmp is still
+ * called with the earlier node first.
+ */
+static unsigned int count_inversions(void *priv, list_cmp_func_t cmp,
+				     struct list_head **a,
+				     struct list_head **tmp, int n)
+{
+	int mid = n / 2, i = 0, j = mid, k = 0;
+	unsigned int inversions;
+
+	if (n < 2)
+		return 0;
+
+	inversions = count_inversions(priv, cmp, a, tmp, mid) +
+		     count_inversions(priv, cmp, a + mid, tmp, n - mid);
+	while (i < mid && j < n) {
+		if (cmp(priv, a[i], a[j]) > 0) {
+			tmp[k++] = a[j++];
+			inversions += mid - i;
+		} else {
+			tmp[k++] = a[i++];
+		}
+	}
+	while (i < mid)
+		tmp[k++] = a[i++];
+	/* The rest of the right half is already in place */
+	memcpy(a, tmp, k * sizeof(*a));
+	return inversions;
+}
+
+/*
+ * Count the descents and the inversions among LIST_SORT_SAMPLE_WINDOW
+ * consecutive nodes from @pos onwards, the latter by merge sort in
+ * O(W log W) comparisons rather than by comparing every pair.
+ */
+static void sample_window(void *priv, list_cmp_func_t cmp,
+			  struct list_head *pos, struct list_sort_sample *sample)
+{
+	struct list_head *window[LIST_SORT_SAMPLE_WINDOW];
+	struct list_head *tmp[LIST_SORT_SAMPLE_WINDOW];
+
+	for (int i = 0; i < LIST_SORT_SAMPLE_WINDOW; i++) {
+		window[i] = pos;
+		pos = pos->next;
+	}
+
+	for (int i = 0; i < LIST_SORT_SAMPLE_WINDOW - 1; i++)
+		sample->descents += cmp(priv, window[i], window[i + 1]) > 0;
+	sample->inversions += count_inversions(priv, cmp, window, tmp,
+					       LIST_SORT_SAMPLE_WINDOW);
+	sample->pairs += LIST_SORT_SAMPLE_WINDOW - 1;
+	sample->inversion_pairs +=
+		LIST_SORT_SAMPLE_WINDOW * (LIST_SORT_SAMPLE_WINDOW - 1) / 2;
+}
+
+/**
+ * list_sort_sample - estimate how presorted a list is
+ * @priv: private data, passed to @cmp
+ * @head: the list to sample
+ * @cmp: the elements comparison function
+ * @sample: where to store the counts
+ *
+ * Counts descents and inversions in a window of LIST_SORT_SAMPLE_WINDOW
+ * nodes at each end of the list.  The head and tail are reached without
+ * walking the list, so the cost is bounded regardless of its length.
+ *
+ * Returns false, leaving @sample zeroed, if the list is too short to
+ * hold two disjoint windows.
+ */
+bool list_sort_sample(void *priv, struct list_head *head, list_cmp_func_t cmp,
+		      struct list_sort_sample *sample)
+{
+	struct list_head *pos = head->next;
+
+	memset(sample, 0, sizeof(*sample));
+
+	for (int i = 0; i < 2 * LIST_SORT_SAMPLE_WINDOW; i++, pos = pos->next)
+		if (pos == head)
+			return false;
+
+	sample_window(priv, cmp, head->next, sample);
+
+	pos = head;
+	for (int i = 0; i < LIST_SORT_SAMPLE_WINDOW; i++)
+		pos = pos->prev;
+	sample_window(priv, cmp, pos, sample);
+
+	sample->run_bucket = sample->descents * LIST_SORT_AUTO_BUCKETS /
+			     (sample->pairs + 1);
+	sample->inv_bucket = sample->inversions * LIST_SORT_AUTO_BUCKETS /
+			     (sample->inversion_pairs + 1);
+	return true;
+}
+
+/**
+ * list_sort_auto - sort a list with the engine that suits its input
+ * @priv: private data, opaque to list_sort_auto(), passed to @cmp
+ * @head: the list to sort
+ * @cmp: the elements comparison function
+ *
+ * Same contract as list_sort().  The list is sampled with
+ * list_sort_sample(), and the descent and inversion rates select an
+ * engine from list_sort_auto_table[], which is generated from the
+ * benchmark by "make auto-table".
+ *
+ * The sample costs about 2 * W * (log2(W) + 1) comparisons, W being
+ * LIST_SORT_SAMPLE_WINDOW, some 800 for W = 64.  Lists shorter than
+ * LIST_SORT_AUTO_MIN nodes go to list_sort() unsampled, as the choice
+ * cannot win back that much there; at LIST_SORT_AUTO_MIN the sample is
+ * under 0.2% of what list_sort() spends on random input.  Finding out
+ * costs a walk of up to LIST_SORT_AUTO_MIN nodes, but no comparisons.
+ */
+void list_sort_auto(void *priv, struct list_head *head, list_cmp_func_t cmp)
+{
+	struct list_sort_sample sample;
+	struct list_head *pos = head->next;
+
+	for (int i = 0; i < LIST_SORT_AUTO_MIN; i++, pos = pos->next) {
+		if (pos == head) {
+			list_sort(priv, head, cmp);
+			return;
+		}
+	}
+
+	if (!list_sort_sample(priv, head, cmp, &sample)) {
+		list_sort(priv, head, cmp);
+		return;
+	}
+
+	list_sort_auto_table[sample.run_bucket][sample.inv_bucket](priv, head,
+								   cmp);
+}
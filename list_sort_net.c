@@ -0,0 +1,265 @@
+// SPDX-License-Identifier: GPL-2.0
+#include "list.h"
+#include "list_sort.h"
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef likely
+# define likely(x)	__builtin_expect(!!(x), 1)
+#endif
+#ifndef unlikely
+# define unlikely(x)	__builtin_expect(!!(x), 0)
+#endif
+
+/* Nodes sorted by the network before they enter pending; a power of two */
+#define NET_BLOCK 8
+
+/*
+ * Comparator networks with the minimal number of comparators for 2 to
+ * NET_BLOCK inputs (Knuth, TAOCP vol. 3, 5.3.4).  Each byte holds the
+ * two positions of one comparator, the lower one in the high nibble.
+ */
+#define CE(i, j) ((i) << 4 | (j))
+
+static const uint8_t net2[] = { CE(0, 1) };
+static const uint8_t net3[] = { CE(1, 2), CE(0, 2), CE(0, 1) };
+static const uint8_t net4[] = {
+	CE(0, 1), CE(2, 3), CE(0, 2), CE(1, 3), CE(1, 2),
+};
+static const uint8_t net5[] = {
+	CE(0, 1), CE(3, 4), CE(2, 4), CE(2, 3), CE(0, 3),
+	CE(0, 2), CE(1, 4), CE(1, 3), CE(1, 2),
+};
+static const uint8_t net6[] = {
+	CE(1, 2), CE(4, 5), CE(0, 2), CE(3, 5), CE(0, 1), CE(3, 4),
+	CE(2, 5), CE(0, 3), CE(1, 4), CE(2, 4), CE(1, 3), CE(2, 3),
+};
+static const uint8_t net7[] = {
+	CE(1, 2), CE(3, 4), CE(5, 6), CE(0, 2), CE(3, 5), CE(4, 6),
+	CE(0, 1), CE(4, 5), CE(2, 6), CE(0, 4), CE(1, 5), CE(0, 3),
+	CE(2, 5), CE(1, 3), CE(2, 4), CE(2, 3),
+};
+static const uint8_t net8[] = {
+	CE(0, 2), CE(1, 3), CE(4, 6), CE(5, 7), CE(0, 4), CE(1, 5), CE(2, 6),
+	CE(3, 7), CE(0, 1), CE(2, 3), CE(4, 5), CE(6, 7), CE(2, 4), CE(3, 5),
+	CE(1, 4), CE(3, 6), CE(1, 2), CE(3, 4), CE(5, 6),
+};
+
+static const struct {
+	const uint8_t *ce;
+	uint8_t len;
+} networks[NET_BLOCK + 1] = {
+	[2] = { net2, sizeof(net2) }, [3] = { net3, sizeof(net3) },
+	[4] = { net4, sizeof(net4) }, [5] = { net5, sizeof(net5) },
+	[6] = { net6, sizeof(net6) }, [7] = { net7, sizeof(net7) },
+	[8] = { net8, sizeof(net8) },
+};
+
+/*
+ * Take up to NET_BLOCK nodes off the front of *@list, sort them with
+ * the network for their number and return them as a null-terminated
+ * list.  *@list is advanced past them.
+ *
+ * A network is not stable by itself, as it swaps nodes across equal
+ * ones.  Each slot therefore carries the input position of its node,
+ * and a comparator orders its pair by (key, position).  That also lets
+ * it call @cmp with the node that came first in the input as @a.
+ */
+static struct list_head *sort_block(void *priv, list_cmp_func_t cmp,
+				    struct list_head **list)
+{
+	struct list_head *node[NET_BLOCK];
+	uint8_t pos[NET_BLOCK];
+	int n = 0;
+
+	do {
+		node[n] = *list;
+		pos[n] = n;
+		n++;
+		*list = (*list)->next;
+	} while (*list && n < NET_BLOCK);
+
+	for (int k = 0; k < networks[n].len; k++) {
+		int i = networks[n].ce[k] >> 4, j = networks[n].ce[k] & 15;
+		struct list_head *lo, *hi;
+		uint8_t plo, phi;
+		bool swap;
+
+		if (pos[i] < pos[j])
+			swap = cmp(priv, node[i], node[j]) > 0;
+		else
+			swap = cmp(priv, node[j], node[i]) <= 0;
+		/* Select rather than branch; the outcome is a coin flip */
+		lo = swap ? node[j] : node[i];
+		hi = swap ? node[i] : node[j];
+		plo = swap ? pos[j] : pos[i];
+		phi = swap ? pos[i] : pos[j];
+		node[i] = lo;
+		node[j] = hi;
+		pos[i] = plo;
+		pos[j] = phi;
+	}
+
+	for (int i = 0; i < n - 1; i++)
+		node[i]->next = node[i + 1];
+	node[n - 1]->next = NULL;
+	return node[0];
+}
+
+/*
+ * Returns a list organized in an intermediate format suited
+ * to chaining of merge() calls: null-terminated, no reserved or
+ * sentinel head node, "prev" links not maintained.
+ */
+static struct list_head *merge(void *priv, list_cmp_func_t cmp,
+				struct list_head *a, struct list_head *b)
+{
+	struct list_head *head, **tail = &head;
+
+	for (;;) {
+		/* if equal, take 'a' -- important for sort stability */
+		if (cmp(priv, a, b) <= 0) {
+			*tail = a;
+			tail = &a->next;
+			a = a->next;
+			if (!a) {
+				*tail = b;
+				break;
+			}
+		} else {
+			*tail = b;
+			tail = &b->next;
+			b = b->next;
+			if (!b) {
+				*tail = a;
+				break;
+			}
+		}
+	}
+	return head;
+}
+
+static void build_prev_link(struct list_head *head, struct list_head *tail,
+			    struct list_head *list)
+{
+	tail->next = list;
+	do {
+		list->prev = tail;
+		tail = list;
+		list = list->next;
+	} while (list);
+
+	/* The final links to make a circular doubly-linked list */
+	tail->next = head;
+	head->prev = tail;
+}
+
+static void merge_final(void *priv, list_cmp_func_t cmp, struct list_head *head,
+			struct list_head *a, struct list_head *b)
+{
+	struct list_head *tail = head;
+
+	for (;;) {
+		/* if equal, take 'a' -- important for sort stability */
+		if (cmp(priv, a, b) <= 0) {
+			tail->next = a;
+			a->prev = tail;
+			tail = a;
+			a = a->next;
+			if (!a)
+				break;
+		} else {
+			tail->next = b;
+			b->prev = tail;
+			tail = b;
+			b = b->next;
+			if (!b) {
+				b = a;
+				break;
+			}
+		}
+	}
+
+	/* Finish linking remainder of list b on to tail */
+	build_prev_link(head, tail, b);
+}
+
+/**
+ * list_sort_net - sort a list, starting from network-sorted blocks
+ * @priv: private data, opaque to list_sort_net(), passed to @cmp
+ * @head: the list to sort
+ * @cmp: the elements comparison function
+ *
+ * Same contract as list_sort().  Instead of moving one node at a time
+ * into pending, each step sorts the next NET_BLOCK nodes with a stable
+ * comparator network and moves them as one sublist.  The first three
+ * levels of merging, which do the most pointer writes per comparison
+ * and whose branches are the least predictable, are replaced by 19
+ * compare-exchanges on an array.
+ *
+ * "count" counts blocks rather than nodes, so the merge schedule above
+ * the blocks is exactly that of list_sort(), including its 2:1 balance.
+ * The last 1 to NET_BLOCK - 1 nodes are sorted by a smaller network and
+ * pushed as one short sublist, which only takes part in the final
+ * merges.
+ *
+ * The network always spends 19 comparisons on a block, where merging
+ * the same 8 nodes takes at most 17, so this trades a few comparisons
+ * for fewer pointer writes; it pays off when @cmp is cheap.
+ */
+void list_sort_net(void *priv, struct list_head *head, list_cmp_func_t cmp)
+{
+	struct list_head *list = head->next, *pending = NULL;
+	size_t count = 0;	/* Count of pending blocks */
+
+	if (list == head->prev)	/* Zero or one elements */
+		return;
+
+	/* Convert to a null-terminated singly-linked list. */
+	head->prev->next = NULL;
+
+	do {
+		size_t bits;
+		struct list_head **tail = &pending, *block;
+
+		/* Find the least-significant clear bit in count */
+		for (bits = count; bits & 1; bits >>= 1)
+			tail = &(*tail)->prev;
+		/* Do the indicated merge */
+		if (likely(bits)) {
+			struct list_head *a = *tail, *b = a->prev;
+
+			a = merge(priv, cmp, b, a);
+			/* Install the merged result in place of the inputs */
+			a->prev = b->prev;
+			*tail = a;
+		}
+
+		/* Move one sorted block from input list to pending */
+		block = sort_block(priv, cmp, &list);
+		block->prev = pending;
+		pending = block;
+		count++;
+	} while (list);
+
+	/* A single block is already the whole sorted list */
+	if (!pending->prev) {
+		build_prev_link(head, head, pending);
+		return;
+	}
+
+	/* End of input; merge together all the pending lists. */
+	list = pending;
+	pending = pending->prev;
+	for (;;) {
+		struct list_head *next = pending->prev;
+
+		if (!next)
+			break;
+		list = merge(priv, cmp, pending, list);
+		pending = next;
+	}
+	/* The final merge, rebuilding prev links */
+	merge_final(priv, cmp, head, pending, list);
+}
@@ -0,0 +1,408 @@
+// SPDX-License-Identifier: GPL-2.0
+#include "list.h"
+#include "list_sort.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+
+/* Every INDEX_STRIDE-th node of a sorted run is recorded in its index */
+#define INDEX_STRIDE 64
+/* Below this many nodes per thread, list_sort() on one thread wins */
+#define MIN_NODES_PER_THREAD 4096
+#define MAX_THREADS 64
+
+/*
+ * A sorted run between merge levels: null-terminated, prev links valid
+ * from the second node on, with index[i] pointing at node i*INDEX_STRIDE.
+ */
+struct prun {
+	struct list_head *list, *last;
+	size_t len;
+	struct list_head **index;
+};
+
+/* One thread's share of the first level: sort a chunk of the input */
+struct chunk {
+	void *priv;
+	list_cmp_func_t cmp;
+	struct list_head head;
+	struct prun *run;
+};
+
+/*
+ * One thread's share of a merge: the nodes of a from @a up to @a_end and
+ * of b from @b up to @b_end, which land at output rank @pos onwards.
+ */
+struct segment {
+	void *priv;
+	list_cmp_func_t cmp;
+	struct list_head *a, *a_end, *b, *b_end;
+	size_t pos;
+	struct list_head **index;
+	struct list_head *first, *last;
+};
+
+static size_t index_len(size_t len)
+{
+	return (len + INDEX_STRIDE - 1) / INDEX_STRIDE;
+}
+
+/*
+ * Run @fn on @nr tasks of @size bytes each, one thread per task.  The
+ * calling thread takes the first task; if a thread cannot be created,
+ * its task runs inline instead.
+ */
+static void run_tasks(void *(*fn)(void *), void *tasks, size_t size, int nr)
+{
+	pthread_t tid[MAX_THREADS];
+	bool started[MAX_THREADS];
+
+	for (int i = 1; i < nr; i++)
+		started[i] = !pthread_create(&tid[i], NULL, fn,
+					     (char *)tasks + i * size);
+	fn(tasks);
+	for (int i = 1; i < nr; i++) {
+		if (started[i])
+			pthread_join(tid[i], NULL);
+		else
+			fn((char *)tasks + i * size);
+	}
+}
+
+static void *sort_chunk(void *arg)
+{
+	struct chunk *c = arg;
+	struct prun *run = c->run;
+	struct list_head *pos;
+	size_t i = 0;
+
+	list_sort(c->priv, &c->head, c->cmp);
+
+	/* Convert to a null-terminated run and index it */
+	run->list = c->head.next;
+	run->last = c->head.prev;
+	run->last->next = NULL;
+	for (pos = run->list; pos; pos = pos->next, i++)
+		if (!(i % INDEX_STRIDE))
+			run->index[i / INDEX_STRIDE] = pos;
+	return NULL;
+}
+
+/*
+ * Merge one segment, linking prev pointers as we go and recording the
+ * index of the merged run at the global output positions.  The segment
+ * is left unlinked at both ends; stitch() joins neighbouring segments.
+ */
+static void *merge_segment(void *arg)
+{
+	struct segment *s = arg;
+	struct list_head *a = s->a, *b = s->b, *tail = NULL, *node;
+	size_t pos = s->pos;
+
+	s->first = NULL;
+	for (;;) {
+		if (a != s->a_end && b != s->b_end) {
+			/* if equal, take 'a' -- important for sort stability */
+			if (s->cmp(s->priv, a, b) <= 0) {
+				node = a;
+				a = a->next;
+			} else {
+				node = b;
+				b = b->next;
+			}
+		} else if (a != s->a_end) {
+			node = a;
+			a = a->next;
+		} else if (b != s->b_end) {
+			node = b;
+			b = b->next;
+		} else {
+			break;
+		}
+
+		if (tail) {
+			tail->next = node;
+			node->prev = tail;
+		} else {
+			s->first = node;
+		}
+		tail = node;
+		if (!(pos % INDEX_STRIDE))
+			s->index[pos / INDEX_STRIDE] = node;
+		pos++;
+	}
+	s->last = tail;
+	return NULL;
+}
+
+/*
+ * Number of nodes of @run that go before @pivot in the merged output,
+ * and the first one that does not (NULL if none).  @pivot_first says
+ * whether @pivot comes from the earlier run and so wins ties.
+ */
+static size_t corank(void *priv, list_cmp_func_t cmp, const struct prun *run,
+		     struct list_head *pivot, bool pivot_first,
+		     struct list_head **node)
+{
+	size_t lo = 0, hi = index_len(run->len), rank;
+	struct list_head *pos;
+
+/* Does node @x of @run go before @pivot? */
+#define before(x)							\
+	(pivot_first ? cmp(priv, pivot, (x)) > 0 : cmp(priv, (x), pivot) <= 0)
+
+	/* Find the last indexed node that goes before the pivot */
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+
+		if (before(run->index[mid]))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (!lo) {
+		*node = run->list;
+		return 0;
+	}
+
+	/* ... and walk from there, at most INDEX_STRIDE nodes */
+	rank = (lo - 1) * INDEX_STRIDE;
+	pos = run->index[lo - 1];
+	while (pos && before(pos)) {
+		rank++;
+		pos = pos->next;
+	}
+#undef before
+
+	*node = pos;
+	return rank;
+}
+
+/*
+ * A valid split of the merge of @a and @b is a pair of positions such
+ * that the output up to there is exactly a[0..i) and b[0..j).  Using the
+ * indexed nodes of both runs as candidate pivots, find the smallest
+ * such output prefix of at least @target nodes, or the end.
+ */
+static void find_split(void *priv, list_cmp_func_t cmp, const struct prun *a,
+		       const struct prun *b, size_t target, struct segment *s)
+{
+	const struct prun *runs[2] = { a, b };
+	size_t best = a->len + b->len;
+
+	s->a = s->b = NULL;
+	s->pos = best;
+
+	for (int r = 0; r < 2; r++) {
+		const struct prun *run = runs[r], *other = runs[!r];
+		size_t lo = 0, hi = index_len(run->len);
+		struct list_head *node;
+
+		/* Smallest pivot whose prefix reaches the target */
+		while (lo < hi) {
+			size_t mid = lo + (hi - lo) / 2;
+
+			if (mid * INDEX_STRIDE +
+			    corank(priv, cmp, other, run->index[mid], !r,
+				   &node) >= target)
+				hi = mid;
+			else
+				lo = mid + 1;
+		}
+		if (lo == index_len(run->len))
+			continue;
+
+		size_t rank = corank(priv, cmp, other, run->index[lo], !r,
+				     &node);
+		if (lo * INDEX_STRIDE + rank >= best)
+			continue;
+
+		best = lo * INDEX_STRIDE + rank;
+		s->pos = best;
+		if (!r) {
+			s->a = run->index[lo];
+			s->b = node;
+		} else {
+			s->a = node;
+			s->b = run->index[lo];
+		}
+	}
+}
+
+/*
+ * Join the merged segments of one pair into a run, fixing up the prev
+ * link of the first node of each segment.
+ */
+static void stitch(struct segment *seg, int nr, struct prun *a, struct prun *b,
+		   struct list_head **index)
+{
+	struct list_head *tail = NULL;
+
+	for (int i = 0; i < nr; i++) {
+		if (!seg[i].first)
+			continue;
+		if (tail) {
+			tail->next = seg[i].first;
+			seg[i].first->prev = tail;
+		} else {
+			a->list = seg[i].first;
+		}
+		tail = seg[i].last;
+	}
+	tail->next = NULL;
+
+	a->last = tail;
+	a->len += b->len;
+	a->index = index;
+}
+
+/**
+ * list_sort_parallel - sort a list on several threads
+ * @priv: private data, opaque to list_sort_parallel(), passed to @cmp
+ * @head: the list to sort
+ * @cmp: the elements comparison function
+ * @threads: number of threads to use, including the caller
+ *
+ * Same contract as list_sort(), except that @cmp is called concurrently
+ * from up to @threads threads with the same @priv.
+ *
+ * The list is cut into @threads chunks, which are sorted in parallel
+ * with list_sort() and indexed every INDEX_STRIDE nodes.  Pairs of runs
+ * are then merged level by level until one is left.  Each merge, the
+ * last one included, is split into as many segments as there are
+ * threads for it: the split points are found by binary search over the
+ * indexed nodes of both runs, and each segment is merged on its own
+ * thread, which also records the index of the merged run for the next
+ * level.  The final merge therefore runs on all threads instead of
+ * being a serial O(n) pass.  prev links are maintained inside each
+ * segment and patched where segments meet.
+ *
+ * Cutting the input still takes one serial walk, which only reads the
+ * nodes.  If memory for the two index buffers cannot be allocated, or
+ * the list is short, this falls back to list_sort().
+ */
+void list_sort_parallel(void *priv, struct list_head *head, list_cmp_func_t cmp,
+			int threads)
+{
+	struct chunk chunks[MAX_THREADS];
+	struct prun runs[MAX_THREADS];
+	struct segment seg[MAX_THREADS];
+	struct list_head *pos, **index, **next_index;
+	size_t n = 0, per_chunk, index_size;
+	int nr_runs;
+
+	if (threads > MAX_THREADS)
+		threads = MAX_THREADS;
+
+	list_for_each(pos, head)
+		n++;
+	if (threads > (int)(n / MIN_NODES_PER_THREAD))
+		threads = n / MIN_NODES_PER_THREAD;
+	if (threads < 2) {
+		list_sort(priv, head, cmp);
+		return;
+	}
+
+	/* Each run rounds its index up by at most one entry */
+	index_size = index_len(n) + threads;
+	index = malloc(sizeof(*index) * 2 * index_size);
+	if (!index) {
+		list_sort(priv, head, cmp);
+		return;
+	}
+	next_index = index + index_size;
+
+	per_chunk = n / threads;
+	for (int i = 0; i < threads; i++) {
+		runs[i].len = i < threads - 1 ? per_chunk :
+						n - per_chunk * (threads - 1);
+		runs[i].index = i ? runs[i - 1].index +
+					    index_len(runs[i - 1].len) :
+				    index;
+	}
+
+	/* Cut the input into one circular list per chunk */
+	pos = head->next;
+	for (int i = 0; i < threads; i++) {
+		struct chunk *c = &chunks[i];
+		struct list_head *first = pos, *last;
+
+		for (size_t k = 1; k < runs[i].len; k++)
+			pos = pos->next;
+		last = pos;
+		pos = pos->next;
+
+		c->priv = priv;
+		c->cmp = cmp;
+		c->run = &runs[i];
+		c->head.next = first;
+		c->head.prev = last;
+		first->prev = &c->head;
+		last->next = &c->head;
+	}
+	run_tasks(sort_chunk, chunks, sizeof(*chunks), threads);
+
+	/* Merge pairs of runs until one is left */
+	for (nr_runs = threads; nr_runs > 1; nr_runs = (nr_runs + 1) / 2) {
+		struct list_head **merged[MAX_THREADS / 2], **swap;
+		int pairs = nr_runs / 2, workers = threads / pairs, nr = 0;
+
+		for (int p = 0; p < pairs; p++)
+			merged[p] = p ? merged[p - 1] +
+					index_len(runs[2 * p - 2].len +
+						  runs[2 * p - 1].len) :
+					next_index;
+
+		for (int p = 0; p < pairs; p++) {
+			struct prun *a = &runs[2 * p], *b = &runs[2 * p + 1];
+			struct segment *s = &seg[nr];
+			size_t len = a->len + b->len;
+
+			s[0] = (struct segment){
+				.priv = priv, .cmp = cmp,
+				.a = a->list, .b = b->list, .pos = 0,
+			};
+			for (int w = 1; w < workers; w++) {
+				s[w].priv = priv;
+				s[w].cmp = cmp;
+				find_split(priv, cmp, a, b, w * len / workers,
+					   &s[w]);
+			}
+			for (int w = 0; w < workers; w++) {
+				s[w].index = merged[p];
+				s[w].a_end = w < workers - 1 ? s[w + 1].a : NULL;
+				s[w].b_end = w < workers - 1 ? s[w + 1].b : NULL;
+			}
+			nr += workers;
+		}
+		run_tasks(merge_segment, seg, sizeof(*seg), nr);
+
+		for (int p = 0; p < pairs; p++) {
+			stitch(&seg[p * workers], workers, &runs[2 * p],
+			       &runs[2 * p + 1], merged[p]);
+			runs[p] = runs[2 * p];
+		}
+		if (nr_runs & 1) {
+			/* The odd run out moves to the other buffer as is */
+			struct prun *odd = &runs[nr_runs - 1];
+			struct list_head **dst = merged[pairs - 1] +
+				index_len(runs[pairs - 1].len);
+
+			for (size_t i = 0; i < index_len(odd->len); i++)
+				dst[i] = odd->index[i];
+			odd->index = dst;
+			runs[pairs] = *odd;
+		}
+
+		swap = index;
+		index = next_index;
+		next_index = swap;
+	}
+
+	/* The final links to make a circular doubly-linked list */
+	head->next = runs[0].list;
+	runs[0].list->prev = head;
+	runs[0].last->next = head;
+	head->prev = runs[0].last;
+	free(index < next_index ? index : next_index);
+}
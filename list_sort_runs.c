@@ -0,0 +1,263 @@
+// SPDX-License-Identifier: GPL-2.0
+#include "list.h"
+#include "list_sort.h"
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef likely
+# define likely(x)	__builtin_expect(!!(x), 1)
+#endif
+#ifndef unlikely
+# define unlikely(x)	__builtin_expect(!!(x), 0)
+#endif
+
+/* At most two pending runs per level, plus the newest run */
+#define MAX_MERGE_PENDING (2 * sizeof(size_t) * 8 + 1)
+
+struct run {
+	struct list_head *list;
+	size_t start;	/* Position of the first node in the input */
+	size_t len;
+	int level;	/* Level of the boundary with the previous run */
+	size_t due;	/* Count at which that boundary is due, or SIZE_MAX */
+	size_t due_min;	/* Least due of this and every run below it */
+};
+
+static struct list_head *merge(void *priv, list_cmp_func_t cmp,
+				struct list_head *a, struct list_head *b)
+{
+	struct list_head *head, **tail = &head;
+
+	for (;;) {
+		/* if equal, take 'a' -- important for sort stability */
+		if (cmp(priv, a, b) <= 0) {
+			*tail = a;
+			tail = &a->next;
+			a = a->next;
+			if (!a) {
+				*tail = b;
+				break;
+			}
+		} else {
+			*tail = b;
+			tail = &b->next;
+			b = b->next;
+			if (!b) {
+				*tail = a;
+				break;
+			}
+		}
+	}
+	return head;
+}
+
+static void build_prev_link(struct list_head *head, struct list_head *tail,
+			    struct list_head *list)
+{
+	tail->next = list;
+	do {
+		list->prev = tail;
+		tail = list;
+		list = list->next;
+	} while (list);
+
+	/* The final links to make a circular doubly-linked list */
+	tail->next = head;
+	head->prev = tail;
+}
+
+static void merge_final(void *priv, list_cmp_func_t cmp, struct list_head *head,
+			struct list_head *a, struct list_head *b)
+{
+	struct list_head *tail = head;
+
+	for (;;) {
+		/* if equal, take 'a' -- important for sort stability */
+		if (cmp(priv, a, b) <= 0) {
+			tail->next = a;
+			a->prev = tail;
+			tail = a;
+			a = a->next;
+			if (!a)
+				break;
+		} else {
+			tail->next = b;
+			b->prev = tail;
+			tail = b;
+			b = b->next;
+			if (!b) {
+				b = a;
+				break;
+			}
+		}
+	}
+
+	/* Finish linking remainder of list b on to tail */
+	build_prev_link(head, tail, b);
+}
+
+/*
+ * Find the run starting at *@head, cut it off as a null-terminated list
+ * and return the remainder of the input.  A strictly descending run is
+ * reversed in place, so *@head is updated to the new first node.
+ */
+static struct list_head *find_run(void *priv, struct list_head **head,
+				  size_t *len, list_cmp_func_t cmp)
+{
+	struct list_head *list = *head;
+	struct list_head *next = list->next;
+
+	*len = 1;
+	if (unlikely(next == NULL))
+		return NULL;
+
+	if (cmp(priv, list, next) > 0) {
+		/* decending run, also reverse the list */
+		struct list_head *prev = NULL;
+		do {
+			(*len)++;
+			list->next = prev;
+			prev = list;
+			list = next;
+			next = list->next;
+		} while (next && cmp(priv, list, next) > 0);
+		list->next = prev;
+		*head = list;
+	} else {
+		do {
+			(*len)++;
+			list = next;
+			next = list->next;
+		} while (next && cmp(priv, list, next) <= 0);
+		list->next = NULL;
+	}
+
+	return next;
+}
+
+/*
+ * The level of the boundary between two adjacent runs is the height of
+ * the smallest aligned power-of-two block that contains the midpoints
+ * of both.  For single-node runs starting at b it is __ffs(b) + 1, which
+ * is the bit of "count" that makes list_sort() merge across b.
+ */
+static int boundary_level(const struct run *a, const struct run *b)
+{
+	size_t mid_a = 2 * a->start + a->len;
+	size_t mid_b = 2 * b->start + b->len;
+
+	return sizeof(size_t) * 8 - 1 - __builtin_clzl(mid_a ^ mid_b);
+}
+
+/*
+ * A pending boundary is due for merging once both of its runs are
+ * complete subtrees (the boundary on the left is higher and the one on
+ * the right is not lower; ties resolve left to right), and the nodes
+ * pending after it weigh at least 2^(level - 1).  The first condition
+ * depends only on the neighbouring boundaries, so it is settled when
+ * the run is pushed or a neighbour merged; the second is a count the
+ * pending nodes must reach.  The newest run never qualifies, since its
+ * right boundary is not known yet.
+ *
+ * Recompute the due counts of the runs from @at up to @tp, whose
+ * boundaries or those below them have changed.
+ */
+static void update_due(struct run *stk, struct run *at, struct run *tp)
+{
+	for (; at <= tp; at++) {
+		at->due = SIZE_MAX;
+		if (at > stk && at < tp && at->level <= at[1].level &&
+		    (at == stk + 1 || at->level < at[-1].level))
+			at->due = at->start + at->len +
+				  ((size_t)1 << (at->level - 1));
+		at->due_min = at > stk && at[-1].due_min < at->due ?
+			      at[-1].due_min : at->due;
+	}
+}
+
+/*
+ * Merge the pending run at @at with the one before it.  The merged run
+ * keeps the left boundary of at[-1]; the boundary at @at disappears.
+ */
+static struct run *merge_at(void *priv, list_cmp_func_t cmp, struct run *stk,
+			    struct run *at, struct run *tp)
+{
+	at[-1].list = merge(priv, cmp, at[-1].list, at[0].list);
+	at[-1].len += at[0].len;
+	for (struct run *p = at; p < tp; p++)
+		p[0] = p[1];
+	update_due(stk, at - 1, tp - 1);
+	return tp - 1;
+}
+
+/* The topmost pending boundary that is due with @count nodes pending */
+static struct run *merge_due(struct run *tp, size_t count)
+{
+	while (tp->due > count)
+		tp--;
+	return tp;
+}
+
+/**
+ * list_sort_runs - sort a list, starting from its natural runs
+ * @priv: private data, opaque to list_sort_runs(), passed to @cmp
+ * @head: the list to sort
+ * @cmp: the elements comparison function
+ *
+ * Same contract as list_sort().  Instead of moving one node at a time
+ * into the pending lists, each step moves a whole natural run (reversing
+ * strictly descending ones), weighted by its length.
+ *
+ * The merge schedule is that of list_sort() expressed in terms of node
+ * positions rather than "count" bits: every boundary between two runs
+ * gets a level from the positions of the runs, and two runs are merged
+ * once they are complete at that level and 2^(level-1) nodes have
+ * been moved to pending after them.  With single-node runs this is
+ * exactly the list_sort() schedule, including its 2:1 balance; on
+ * presorted input there are few boundaries and few merges, as in
+ * timsort().  Every run keeps the least due count at or below it, so
+ * a push that makes nothing due costs O(1), and a merge only updates
+ * the runs above it.
+ */
+void list_sort_runs(void *priv, struct list_head *head, list_cmp_func_t cmp)
+{
+	struct list_head *list = head->next;
+	struct run stk[MAX_MERGE_PENDING], *tp = stk - 1;
+	size_t count = 0;	/* Count of pending */
+
+	if (list == head->prev)	/* Zero or one elements */
+		return;
+
+	/* Convert to a null-terminated singly-linked list. */
+	head->prev->next = NULL;
+
+	do {
+		tp++;
+		/* Move one run from input list to pending */
+		tp->list = list;
+		tp->start = count;
+		list = find_run(priv, &tp->list, &tp->len, cmp);
+		count += tp->len;
+		if (likely(tp > stk)) {
+			tp->level = boundary_level(&tp[-1], tp);
+			update_due(stk, tp - 1, tp);
+		} else {
+			update_due(stk, tp, tp);
+		}
+
+		while (tp->due_min <= count)
+			tp = merge_at(priv, cmp, stk, merge_due(tp, count), tp);
+	} while (list);
+
+	/* End of input; merge together all the pending lists. */
+	list = tp->list;
+	while (--tp > stk)
+		list = merge(priv, cmp, tp->list, list);
+
+	/* The final merge, rebuilding prev links */
+	if (tp == stk)
+		merge_final(priv, cmp, head, stk->list, list);
+	else
+		build_prev_link(head, head, list);
+}
@@ -0,0 +1,120 @@
+// SPDX-License-Identifier: GPL-2.0
+#include "list.h"
+#include "list_sort.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#ifndef likely
+# define likely(x)	__builtin_expect(!!(x), 1)
+#endif
+#ifndef unlikely
+# define unlikely(x)	__builtin_expect(!!(x), 0)
+#endif
+
+/* Longest list sorted through the pointer arrays; 1 KB of stack */
+#define SMALL_SORT_MAX 64
+
+/* Runs this long are insertion sorted before the merge passes */
+#define SMALL_RUN 8
+
+/* Stable straight insertion sort of the @n node pointers at @a */
+static void insertion_sort(void *priv, list_cmp_func_t cmp,
+			   struct list_head **a, int n)
+{
+	for (int i = 1; i < n; i++) {
+		struct list_head *node = a[i];
+		int j = i;
+
+		while (j > 0 && cmp(priv, a[j - 1], node) > 0) {
+			a[j] = a[j - 1];
+			j--;
+		}
+		a[j] = node;
+	}
+}
+
+/*
+ * Stable bottom-up merge sort of @n node pointers, between @a and @b:
+ * runs of SMALL_RUN are insertion sorted in place, then merged in
+ * passes that alternate between the two arrays.  Returns the array
+ * holding the result.
+ */
+static struct list_head **merge_sort(void *priv, list_cmp_func_t cmp,
+				     struct list_head **a,
+				     struct list_head **b, int n)
+{
+	for (int lo = 0; lo < n; lo += SMALL_RUN)
+		insertion_sort(priv, cmp, a + lo,
+			       n - lo < SMALL_RUN ? n - lo : SMALL_RUN);
+
+	for (int width = SMALL_RUN; width < n; width *= 2) {
+		struct list_head **t;
+
+		for (int lo = 0; lo < n; lo += 2 * width) {
+			int i = lo, mid = lo + width < n ? lo + width : n;
+			int j = mid, hi = mid + width < n ? mid + width : n;
+			int k = lo;
+
+			while (i < mid && j < hi) {
+				int take_a = cmp(priv, a[i], a[j]) <= 0;
+
+				b[k++] = take_a ? a[i] : a[j];
+				i += take_a;
+				j += !take_a;
+			}
+			while (i < mid)
+				b[k++] = a[i++];
+			while (j < hi)
+				b[k++] = a[j++];
+		}
+		t = a;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+/**
+ * list_sort_small - list_sort() with a fast path for short lists
+ * @priv: private data, opaque to list_sort_small(), passed to @cmp
+ * @head: the list to sort
+ * @cmp: the elements comparison function
+ *
+ * Same result and @cmp contract as list_sort(), and stable.
+ *
+ * Lists of up to SMALL_SORT_MAX nodes, such as plug lists, are common,
+ * and for them list_sort()'s pending bookkeeping and merge_final() cost
+ * about as much as the comparisons.  Here the node pointers are copied
+ * to an array on the stack, merge sorted between it and a second array,
+ * and the list is relinked in one pass.  A longer list is found out after
+ * SMALL_SORT_MAX + 1 nodes and handed to list_sort() as it is.
+ */
+void list_sort_small(void *priv, struct list_head *head, list_cmp_func_t cmp)
+{
+	struct list_head *nodes[SMALL_SORT_MAX], *tmp[SMALL_SORT_MAX], **sorted;
+	struct list_head *pos = head->next, *prev = head;
+	int n = 0;
+
+	if (pos == head->prev)	/* Zero or one elements */
+		return;
+
+	for (; pos != head; pos = pos->next) {
+		if (unlikely(n == SMALL_SORT_MAX)) {
+			list_sort(priv, head, cmp);
+			return;
+		}
+		nodes[n++] = pos;
+	}
+
+	sorted = merge_sort(priv, cmp, nodes, tmp, n);
+
+	for (int i = 0; i < n; i++) {
+		prev->next = sorted[i];
+		sorted[i]->prev = prev;
+		prev = sorted[i];
+	}
+	prev->next = head;
+	head->prev = prev;
+}
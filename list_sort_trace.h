@@ -0,0 +1,37 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#pragma once
+
+/*
+ * USDT probes of the sort engines.  The provider is the engine
+ * (list_sort, timsort or shiverssort), and the probes are:
+ *
+ *   entry(head)		sort starts, past the early return for a
+ *				list too short to sort
+ *   run(len)			find_run() cut off a run of len nodes
+ *   merge(len_a, len_b)	two sorted sublists are merged, a being the
+ *				one earlier in the input
+ *   exit(head, n)		the n nodes are sorted and relinked
+ *
+ * list_sort() has no run probe, as its runs are single nodes, and
+ * timsort_prefetch() fires the timsort probes.  A probe is a nop and an
+ * ELF note telling the tracer where its arguments are, so it costs
+ * nothing until bpftrace or perf attaches to it.  Without <sys/sdt.h>
+ * the probes compile to nothing.
+ */
+#if defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define LIST_SORT_HAVE_SDT 1
+#endif
+#endif
+
+#ifdef LIST_SORT_HAVE_SDT
+#define LIST_SORT_PROBE1(provider, name, a) DTRACE_PROBE1(provider, name, a)
+#define LIST_SORT_PROBE2(provider, name, a, b) \
+	DTRACE_PROBE2(provider, name, a, b)
+#else
+/* sizeof keeps the arguments "used" without evaluating them */
+#define LIST_SORT_PROBE1(provider, name, a) ((void)sizeof(a))
+#define LIST_SORT_PROBE2(provider, name, a, b) \
+	((void)sizeof(a), (void)sizeof(b))
+#endif
@@ -0,0 +1,282 @@
+// SPDX-License-Identifier: GPL-2.0
+#include "list.h"
+#include "list_sort.h"
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef likely
+# define likely(x)	__builtin_expect(!!(x), 1)
+#endif
+#ifndef unlikely
+# define unlikely(x)	__builtin_expect(!!(x), 0)
+#endif
+
+/* Sublists this short are insertion sorted */
+#define INSERTION_MAX 16
+
+/*
+ * A null-terminated sublist being built, with its length, the link to
+ * append the next node through and its middle node, which trails the
+ * appends at half speed.  The next pass takes its pivot from the first,
+ * middle and last nodes without walking the sublist again.
+ */
+struct part {
+	struct list_head *head, **tail, *mid;
+	size_t len;
+};
+
+static void part_init(struct part *p)
+{
+	p->head = NULL;
+	p->tail = &p->head;
+	p->mid = NULL;
+	p->len = 0;
+}
+
+static void part_add(struct part *p, struct list_head *node)
+{
+	*p->tail = node;
+	p->tail = &node->next;
+	if (!(p->len++ & 1))
+		p->mid = p->mid ? p->mid->next : node;
+}
+
+/* The last node of a non-empty @p */
+static struct list_head *part_last(const struct part *p)
+{
+	return container_of(p->tail, struct list_head, next);
+}
+
+/*
+ * Returns a list organized in an intermediate format suited
+ * to chaining of merge() calls: null-terminated, no reserved or
+ * sentinel head node, "prev" links not maintained.
+ */
+static struct list_head *merge(void *priv, list_cmp_func_t cmp,
+				struct list_head *a, struct list_head *b)
+{
+	struct list_head *head, **tail = &head;
+
+	for (;;) {
+		if (cmp(priv, a, b) <= 0) {
+			*tail = a;
+			tail = &a->next;
+			a = a->next;
+			if (!a) {
+				*tail = b;
+				break;
+			}
+		} else {
+			*tail = b;
+			tail = &b->next;
+			b = b->next;
+			if (!b) {
+				*tail = a;
+				break;
+			}
+		}
+	}
+	return head;
+}
+
+/*
+ * The O(n log n) fallback for sublists that partition badly: the
+ * list_sort() merge schedule, with the pending sublists chained
+ * through prev.  Returns the sorted null-terminated list.
+ */
+static struct list_head *merge_sort(void *priv, list_cmp_func_t cmp,
+				    struct list_head *list)
+{
+	struct list_head *pending = NULL;
+	size_t count = 0;
+
+	do {
+		size_t bits;
+		struct list_head **tail = &pending;
+
+		for (bits = count; bits & 1; bits >>= 1)
+			tail = &(*tail)->prev;
+		if (likely(bits)) {
+			struct list_head *a = *tail, *b = a->prev;
+
+			a = merge(priv, cmp, b, a);
+			a->prev = b->prev;
+			*tail = a;
+		}
+
+		list->prev = pending;
+		pending = list;
+		list = list->next;
+		pending->next = NULL;
+		count++;
+	} while (list);
+
+	list = pending;
+	while ((pending = pending->prev))
+		list = merge(priv, cmp, pending, list);
+	return list;
+}
+
+static struct list_head *insertion_sort(void *priv, list_cmp_func_t cmp,
+					struct list_head *list)
+{
+	struct list_head *sorted = NULL;
+
+	while (list) {
+		struct list_head *node = list, **pos = &sorted;
+
+		list = list->next;
+		while (*pos && cmp(priv, node, *pos) > 0)
+			pos = &(*pos)->next;
+		node->next = *pos;
+		*pos = node;
+	}
+	return sorted;
+}
+
+/* The median of three nodes, using only "> 0" so boolean @cmp works */
+static struct list_head *median3(void *priv, list_cmp_func_t cmp,
+				 struct list_head *a, struct list_head *b,
+				 struct list_head *c)
+{
+	if (cmp(priv, a, b) > 0) {
+		struct list_head *t = a;
+
+		a = b;
+		b = t;
+	}
+	/* a <= b */
+	if (cmp(priv, b, c) <= 0)
+		return b;
+	return cmp(priv, a, c) > 0 ? a : c;
+}
+
+/*
+ * Split @list into the nodes less than, equal to and greater than
+ * @pivot.  A zero from @cmp is ambiguous, since a boolean @cmp returns
+ * it for "less" as well, so it costs a second comparison the other way.
+ */
+static void partition(void *priv, list_cmp_func_t cmp, struct list_head *list,
+		      struct list_head *pivot, struct part *lt, struct part *eq,
+		      struct part *gt)
+{
+	part_init(lt);
+	part_init(eq);
+	part_init(gt);
+
+	while (list) {
+		struct list_head *next = list->next;
+		int c = cmp(priv, list, pivot);
+
+		if (c > 0)
+			part_add(gt, list);
+		else if (c < 0 || cmp(priv, pivot, list) > 0)
+			part_add(lt, list);
+		else
+			part_add(eq, list);
+		list = next;
+	}
+	*lt->tail = *eq->tail = *gt->tail = NULL;
+}
+
+/*
+ * Sort the nodes of @p and append them at *@out; returns the link
+ * after the last one.  The smaller side is sorted recursively and the
+ * loop goes on with the larger one, so the recursion is at most log2(n)
+ * deep.  When the larger side comes first, the sorted equal and greater
+ * nodes are parked on @suffix, which is appended at the very end.
+ */
+static struct list_head **sort_append(void *priv, list_cmp_func_t cmp,
+				      struct part p, int depth,
+				      struct list_head **out)
+{
+	struct list_head *suffix = NULL, **suffix_tail = NULL;
+
+	for (;;) {
+		struct part lt, eq, gt;
+
+		if (p.len <= INSERTION_MAX || unlikely(depth-- == 0)) {
+			*out = p.len <= INSERTION_MAX ?
+			       insertion_sort(priv, cmp, p.head) :
+			       merge_sort(priv, cmp, p.head);
+			while (*out)
+				out = &(*out)->next;
+			break;
+		}
+
+		partition(priv, cmp, p.head,
+			  median3(priv, cmp, p.head, p.mid, part_last(&p)),
+			  &lt, &eq, &gt);
+
+		if (lt.len <= gt.len) {
+			out = sort_append(priv, cmp, lt, depth, out);
+			*out = eq.head;
+			out = eq.tail;
+			p = gt;
+		} else {
+			struct list_head *sorted = NULL, **tail;
+
+			tail = sort_append(priv, cmp, gt, depth, &sorted);
+			*tail = suffix;
+			if (!suffix_tail)
+				suffix_tail = sorted ? tail : eq.tail;
+			*eq.tail = sorted ? sorted : suffix;
+			suffix = eq.head;
+			p = lt;
+		}
+	}
+
+	*out = suffix;
+	return suffix_tail ? suffix_tail : out;
+}
+
+/**
+ * list_sort_unstable - sort a list, without keeping equal elements in order
+ * @priv: private data, opaque to list_sort_unstable(), passed to @cmp
+ * @head: the list to sort
+ * @cmp: the elements comparison function
+ *
+ * Like list_sort(), but elements that compare equal may come out in any
+ * order, and @cmp is called with the nodes in either order.  Both the
+ * <0/=0/>0 and the boolean styles of @cmp work; the former saves a
+ * comparison per node that is not greater than the pivot.
+ *
+ * This is a quicksort on the links: the pivot is the median of the
+ * first, middle and last node, and each pass relinks the nodes into
+ * less, equal and greater lists, so runs of equal keys are done after
+ * one pass.  Recursion is on the smaller side only, and a sublist still
+ * unsorted after 2*log2(n) levels is merge sorted, which bounds the
+ * time at O(n log n) and the stack at O(log n) frames.
+ */
+void list_sort_unstable(void *priv, struct list_head *head,
+			list_cmp_func_t cmp)
+{
+	struct list_head *list = head->next, *tail;
+	struct part all;
+	int depth = 0;
+
+	if (list == head->prev)	/* Zero or one elements */
+		return;
+
+	/* Convert to a null-terminated singly-linked list. */
+	head->prev->next = NULL;
+
+	part_init(&all);
+	for (struct list_head *pos = list; pos; pos = pos->next)
+		part_add(&all, pos);
+	for (size_t m = all.len; m > 1; m >>= 1)
+		depth += 2;
+
+	sort_append(priv, cmp, all, depth, &list);
+
+	/* Rebuild the prev links */
+	tail = head;
+	for (; list; list = list->next) {
+		tail->next = list;
+		list->prev = tail;
+		tail = list;
+	}
+	tail->next = head;
+	head->prev = tail;
+}
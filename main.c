@@ -4,36 +4,299 @@
 #include <stdio.h>
 #include <time.h>
 #include <stdint.h>
+#include <inttypes.h>
 #include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_CLFLUSH 1
+#endif
+
+/* Name of the build matrix configuration, see "make matrix" */
+#ifndef BUILD_CONFIG
+#define BUILD_CONFIG ""
+#endif
 
 typedef struct element {
 	struct list_head list;
 	int val;
 	int seq;
+	const void *key;	/* Out-of-line copy of val, see set_key() */
 } element_t;
 
 #define SAMPLES ((1 << 20) + 20)
 
-static void create_sample(struct list_head *head, element_t *space, int samples)
+/* Number of in-order walks timed after each sort in compact mode */
+#define TRAVERSE_PASSES 16
+
+/* Largest list size visited by the sweep mode */
+#define SWEEP_MAX ((size_t)1 << 27)
+/* Smaller lists are sorted in batches totalling about this many nodes */
+#define SWEEP_BATCH_NODES 1024
+/* Each size is repeated until at least this many nodes were sorted */
+#define SWEEP_MIN_WORK ((uint64_t)1 << 22)
+
+/* Largest list size of the small-list latency mode */
+#define SMALL_MAX 128
+/* Each size is sorted as this many lists with different keys */
+#define SMALL_LISTS 256
+/* and repeated until at least this many lists were sorted */
+#define SMALL_MIN_LISTS 16384
+
+/* Each engine runs this long per instance count in throughput mode */
+#define THROUGHPUT_NS ((uint64_t)500 * 1000 * 1000)
+
+/* Stack of the thread each engine runs on in stack mode */
+#define STACK_BYTES ((size_t)4 << 20)
+/* Fill byte of that stack; the lowest byte changed marks the peak use */
+#define STACK_PAINT 0xa5
+
+/* Cache line size assumed when flushing */
+#define CACHE_LINE 64
+/* LLC size assumed when sysfs does not tell */
+#define LLC_DEFAULT ((size_t)64 << 20)
+
+/* Passes over the whole baseline suite; each times every entry once */
+#define BENCH_PASSES 5
+/* Each timing sorts the input until this many nodes were sorted */
+#define BENCH_MIN_WORK ((uint64_t)1 << 19)
+/* Seed of the suite inputs, so comparison counts are reproducible */
+#define BENCH_SEED 1050
+/* Slowdown below which a time difference is never reported */
+#define BENCH_TOLERANCE 0.02
+/* Welch t statistic above which a time difference is significant */
+#define BENCH_T_CRIT 3.0
+
+/* Benchmark modes selected on the command line */
+enum mode {
+	MODE_DEFAULT,
+	MODE_COMPACT,
+	MODE_SWEEP,
+	MODE_AUTO_TABLE,
+	MODE_PRESORT,
+	MODE_BASELINE,
+	MODE_COMPARE,
+	MODE_THROUGHPUT,
+	MODE_STACK,
+	MODE_SMALL,
+};
+
+/*
+ * How the default mode gets the nodes out of the caches before the
+ * cold run of each engine.
+ */
+enum evict_method {
+	EVICT_NONE,
+	EVICT_FLUSH,	/* clflush every line of the nodes and keys */
+	EVICT_STREAM,	/* write a buffer twice the size of the LLC */
+	NR_EVICT_METHODS,
+};
+
+static const char *evict_names[NR_EVICT_METHODS] = {
+	[EVICT_NONE] = "none",
+	[EVICT_FLUSH] = "flush",
+	[EVICT_STREAM] = "stream",
+};
+
+/*
+ * Where the copies of the sample are placed in memory.  With the
+ * sequential layout, the input order matches the address order; with
+ * the shuffled layout, consecutive input nodes land on random slots.
+ */
+enum layout {
+	LAYOUT_SEQUENTIAL,
+	LAYOUT_SHUFFLED,
+	NR_LAYOUTS,
+};
+
+static const char *layout_names[NR_LAYOUTS] = {
+	[LAYOUT_SEQUENTIAL] = "sequential",
+	[LAYOUT_SHUFFLED] = "shuffled",
+};
+
+/*
+ * How the comparator reaches and compares the key.  All profiles order
+ * the elements exactly as val does, so check_list() holds for each.
+ */
+enum key_profile {
+	KEY_INT,	/* val, in the same cache line as the list_head */
+	KEY_PTR,	/* int behind elem->key */
+	KEY_STR,	/* variable-length string behind elem->key */
+	KEY_TUPLE,	/* three-level tuple behind elem->key */
+	KEY_LATENCY,	/* val plus a fixed delay per comparison */
+	NR_KEY_PROFILES,
+};
+
+/* Shared prefix that strcmp() has to scan past in the string profile */
+#define STR_KEY_PREFIX "/sys/devices/system/node/"
+#define STR_KEY_SIZE 64
+/* Delay loop iterations of the fixed-latency profile */
+#define CMP_LATENCY_LOOPS 64
+
+struct tuple_key {
+	int high, middle, low;
+};
+
+static enum key_profile key_profile = KEY_INT;
+static void *key_pool;
+
+/*
+ * Bytes each node of a copy takes, and where the int key sits relative
+ * to its list_head.  By default the nodes are bare element_t and the
+ * key is val; -e and -o model larger objects with the key further away,
+ * in which case a second copy of val is kept at key_offset.
+ */
+#define KEY_OFFSET_DEFAULT \
+	((ptrdiff_t)(offsetof(element_t, val) - offsetof(element_t, list)))
+
+static size_t elem_stride = sizeof(element_t);
+static ptrdiff_t key_offset = KEY_OFFSET_DEFAULT;
+
+/* Node @i of a copy at @space */
+static element_t *elem_at(void *space, size_t i)
+{
+	return (element_t *)((char *)space + i * elem_stride);
+}
+
+/* Set the key of a node of a copy, both as val and at key_offset */
+static void set_val(element_t *elem, int val)
 {
-	for (int i = 0; i < samples; i++) {
+	elem->val = val;
+	*(int *)((char *)&elem->list + key_offset) = val;
+}
+
+static size_t key_size(enum key_profile profile)
+{
+	switch (profile) {
+	case KEY_PTR:
+		return sizeof(int);
+	case KEY_STR:
+		return STR_KEY_SIZE;
+	case KEY_TUPLE:
+		return sizeof(struct tuple_key);
+	default:
+		return 0;
+	}
+}
+
+/*
+ * Store the out-of-line key of @elem in key_pool, indexed by seq so
+ * every copy of a sample element shares one key.
+ */
+static void set_key(element_t *elem)
+{
+	char *key = (char *)key_pool + elem->seq * key_size(key_profile);
+
+	/* Biased so the hex digits of negative keys sort below positive */
+	unsigned int biased = (unsigned int)elem->val ^ 0x80000000u;
+
+	switch (key_profile) {
+	case KEY_PTR:
+		*(int *)key = elem->val;
+		break;
+	case KEY_STR:
+		snprintf(key, STR_KEY_SIZE, "%s%08x%.*s", STR_KEY_PREFIX,
+			 biased, (int)(biased % 16), "................");
+		break;
+	case KEY_TUPLE:
+		*(struct tuple_key *)key = (struct tuple_key){
+			.high = elem->val >> 20,
+			.middle = (elem->val >> 10) & 0x3ff,
+			.low = elem->val & 0x3ff,
+		};
+		break;
+	default:
+		key = NULL;
+		break;
+	}
+	elem->key = key;
+}
+
+static void create_sample(struct list_head *head, element_t *space,
+			  const int *keys, size_t samples)
+{
+	for (size_t i = 0; i < samples; i++) {
 		element_t *elem = space+i;
-		elem->val = rand();
+		elem->val = keys[i];
 		elem->seq = i;
+		set_key(elem);
 		list_add_tail(&elem->list, head);
 	}
 }
 
-static void copy_list(struct list_head *from, struct list_head *to, element_t *space)
+static size_t *create_slots(size_t samples, enum layout layout)
+{
+	size_t *slots;
+
+	if (layout == LAYOUT_SEQUENTIAL)
+		return NULL;
+
+	slots = malloc(sizeof(*slots) * samples);
+	for (size_t i = 0; i < samples; i++)
+		slots[i] = i;
+	for (size_t i = samples - 1; i > 0; i--) {
+		size_t j = rand() % (i + 1);
+		size_t tmp = slots[i];
+		slots[i] = slots[j];
+		slots[j] = tmp;
+	}
+	return slots;
+}
+
+/*
+ * Byte offset of every node of a copy of the sample, in input order.
+ * A node takes its trace size from @sizes, if given and at least
+ * elem_stride, rounded up to the alignment of element_t; the
+ * nodes are laid out in the order @layout gives.  *@bytes is set to
+ * the space one copy takes.
+ */
+static size_t *create_offsets(size_t n, enum layout layout,
+			      const uint32_t *sizes, size_t *bytes)
+{
+	size_t *slots = create_slots(n, layout);
+	size_t *order = malloc(sizeof(*order) * n);
+	size_t *offsets = malloc(sizeof(*offsets) * n);
+	size_t pos = 0;
+
+	/* order[k] is the node at the k-th place in memory */
+	for (size_t i = 0; i < n; i++)
+		order[slots ? slots[i] : i] = i;
+	for (size_t k = 0; k < n; k++) {
+		size_t i = order[k], size = elem_stride;
+
+		if (sizes && sizes[i] > size)
+			size = (sizes[i] + _Alignof(element_t) - 1) &
+			       ~(_Alignof(element_t) - 1);
+		offsets[i] = pos;
+		pos += size;
+	}
+	*bytes = pos;
+
+	free(order);
+	free(slots);
+	return offsets;
+}
+
+static void copy_list(struct list_head *from, struct list_head *to,
+		      void *space, const size_t *offsets)
 {
 	if (list_empty(from))
 		return;
 
 	element_t *entry;
+	size_t i = 0;
 	list_for_each_entry(entry, from, list) {
-		element_t *copy = space++;
-		copy->val = entry->val;
+		element_t *copy = (element_t *)((char *)space + offsets[i++]);
+		set_val(copy, entry->val);
 		copy->seq = entry->seq;
+		copy->key = entry->key;
 		list_add_tail(&copy->list, to);
 	}
 }
@@ -49,36 +312,201 @@ static void free_list(struct list_head *head)
 }
 #endif
 
-int compare(void *priv, const struct list_head *a, const struct list_head *b)
+int compare_int(void *priv, const struct list_head *a,
+		const struct list_head *b)
 {
 	if (a == b)
 		return 0;
 
-	int res = list_entry(a, element_t, list)->val -
-		  list_entry(b, element_t, list)->val;
+	int va = list_entry(a, element_t, list)->val;
+	int vb = list_entry(b, element_t, list)->val;
+	/* Not va - vb, which overflows on keys from a full-range trace */
+	int res = (va > vb) - (va < vb);
 
 	if (priv) {
-		*((int *)priv) += 1;
+		*((uint64_t *)priv) += 1;
 	}
 
 	return res;
 }
 
-bool check_list(struct list_head *head, int count)
+/* The int key at key_offset from the list_head, as placed by -o */
+int compare_offset(void *priv, const struct list_head *a,
+		   const struct list_head *b)
 {
-	if (list_empty(head))
-		return count == 0;
+	if (a == b)
+		return 0;
 
-	element_t *entry, *safe;
-	list_for_each_entry_safe(entry, safe, head, list) {
-		if (entry->list.next != head) {
-			if (entry->val > safe->val ||
-			    (entry->val == safe->val && entry->seq > safe->seq)) {
+	int va = *(const int *)((const char *)a + key_offset);
+	int vb = *(const int *)((const char *)b + key_offset);
+
+	if (priv) {
+		*((uint64_t *)priv) += 1;
+	}
+
+	return (va > vb) - (va < vb);
+}
+
+int compare_ptr(void *priv, const struct list_head *a,
+		const struct list_head *b)
+{
+	if (a == b)
+		return 0;
+
+	const int *ka = list_entry(a, element_t, list)->key;
+	const int *kb = list_entry(b, element_t, list)->key;
+
+	if (priv) {
+		*((uint64_t *)priv) += 1;
+	}
+
+	return (*ka > *kb) - (*ka < *kb);
+}
+
+int compare_str(void *priv, const struct list_head *a,
+		const struct list_head *b)
+{
+	if (a == b)
+		return 0;
+
+	int res = strcmp(list_entry(a, element_t, list)->key,
+			 list_entry(b, element_t, list)->key);
+
+	if (priv) {
+		*((uint64_t *)priv) += 1;
+	}
+
+	return res;
+}
+
+int compare_tuple(void *priv, const struct list_head *a,
+		  const struct list_head *b)
+{
+	if (a == b)
+		return 0;
+
+	const struct tuple_key *ka = list_entry(a, element_t, list)->key;
+	const struct tuple_key *kb = list_entry(b, element_t, list)->key;
+
+	if (priv) {
+		*((uint64_t *)priv) += 1;
+	}
+
+	if (ka->high != kb->high)
+		return (ka->high > kb->high) - (ka->high < kb->high);
+	if (ka->middle != kb->middle)
+		return (ka->middle > kb->middle) - (ka->middle < kb->middle);
+	return (ka->low > kb->low) - (ka->low < kb->low);
+}
+
+int compare_latency(void *priv, const struct list_head *a,
+		    const struct list_head *b)
+{
+	for (int i = 0; i < CMP_LATENCY_LOOPS; i++)
+		__asm__ __volatile__("" ::: "memory");
+
+	return compare_int(priv, a, b);
+}
+
+static const struct {
+	const char *name;
+	list_cmp_func_t cmp;
+} key_profiles[NR_KEY_PROFILES] = {
+	[KEY_INT] = { "int", compare_int },
+	[KEY_PTR] = { "ptr", compare_ptr },
+	[KEY_STR] = { "str", compare_str },
+	[KEY_TUPLE] = { "tuple", compare_tuple },
+	[KEY_LATENCY] = { "latency", compare_latency },
+};
+
+/* The comparator of the selected key profile */
+static list_cmp_func_t compare = compare_int;
+
+/*
+ * timsort_key() orders by the int key at key_offset directly.  Every key
+ * profile orders the elements as val does, so it sorts the same way
+ * under each.
+ */
+static void key_sort(void *priv, struct list_head *head, list_cmp_func_t cmp)
+{
+	timsort_key(head, key_offset);
+}
+
+/* Nodes ahead that timsort_prefetch() prefetches, see -P */
+#define PREFETCH_DISTANCE 4
+
+static int prefetch_distance = PREFETCH_DISTANCE;
+
+/*
+ * timsort_prefetch() is told where the key is only if -o moved it off
+ * the list_head's cache line; the int profile's val is on that line.
+ */
+static void prefetch_sort(void *priv, struct list_head *head,
+			  list_cmp_func_t cmp)
+{
+	timsort_prefetch(priv, head, cmp,
+			 key_offset == KEY_OFFSET_DEFAULT ? 0 : key_offset,
+			 prefetch_distance);
+}
+
+/* Threads used by list_sort_parallel() */
+static int parallel_threads;
+
+/*
+ * The comparators count into *priv without locking, so the parallel
+ * engine runs uncounted rather than racing on the counter.
+ */
+static void parallel_sort(void *priv, struct list_head *head,
+			  list_cmp_func_t cmp)
+{
+	list_sort_parallel(NULL, head, cmp, parallel_threads);
+}
+
+/*
+ * Check that @head holds @count nodes in sorted order, and in input
+ * order among equal keys if @stable, with every prev link pointing back
+ * to its predecessor.
+ */
+bool check_list(struct list_head *head, size_t count, bool stable)
+{
+	struct list_head *pos;
+	size_t n = 0;
+
+	for (pos = head; pos->next != head; pos = pos->next) {
+		element_t *next = list_entry(pos->next, element_t, list);
+
+		if (pos->next->prev != pos || ++n > count)
+			return false;
+		if (pos != head) {
+			element_t *entry = list_entry(pos, element_t, list);
+
+			if (entry->val > next->val ||
+			    (stable && entry->val == next->val &&
+			     entry->seq > next->seq))
 				return false;
-			}
 		}
 	}
-	return true;
+	return head->prev == pos && n == count;
+}
+
+static long traverse_list(struct list_head *head)
+{
+	element_t *entry;
+	long sum = 0;
+
+	list_for_each_entry(entry, head, list)
+		sum += entry->val;
+	return sum;
+}
+
+static clock_t time_traverse(struct list_head *head)
+{
+	static volatile long sink;
+	clock_t begin = clock();
+
+	for (int i = 0; i < TRAVERSE_PASSES; i++)
+		sink += traverse_list(head);
+	return clock() - begin;
 }
 
 typedef void (*test_func_t)(void *priv, struct list_head *head,
@@ -87,52 +515,1383 @@ typedef void (*test_func_t)(void *priv, struct list_head *head,
 typedef struct test {
 	test_func_t fp;
 	char *name;
+	bool unstable;	/* Equal keys may come out in any order */
+	bool no_cmp;	/* Has no comparison count: cmp is not called or
+			 * not counted */
 } test_t;
 
-int main(void)
+/*
+ * Compare sort+traverse against sort+compact+traverse.  The sorted
+ * nodes are scattered across the data set in both layouts; compaction
+ * pays one extra copy to make every following walk sequential.
+ */
+static void bench_compact(test_t *tests, struct list_head *sample_head,
+			  element_t *testdata, element_t *arena, size_t nums,
+			  const uint32_t *sizes)
+{
+	struct list_head testdata_head;
+
+	for (enum layout layout = 0; layout < NR_LAYOUTS; layout++) {
+		size_t bytes;
+		size_t *offsets = create_offsets(nums, layout, sizes, &bytes);
+
+		for (test_t *test = tests; test->fp != NULL; test++) {
+			clock_t begin, sort, compact, scattered, compacted;
+
+			printf("==== Compacting %s (%s) ====\n", test->name,
+			       layout_names[layout]);
+
+			INIT_LIST_HEAD(&testdata_head);
+			copy_list(sample_head, &testdata_head, testdata, offsets);
+			begin = clock();
+			test->fp(NULL, &testdata_head, compare);
+			sort = clock() - begin;
+			scattered = time_traverse(&testdata_head);
+
+			INIT_LIST_HEAD(&testdata_head);
+			copy_list(sample_head, &testdata_head, testdata, offsets);
+			test->fp(NULL, &testdata_head, compare);
+			begin = clock();
+			list_sort_compact(&testdata_head, elem_stride,
+					  offsetof(element_t, list), arena);
+			compact = clock() - begin;
+			compacted = time_traverse(&testdata_head);
+
+			printf("  Sort time:      %ld\n", sort);
+			printf("  Compact time:   %ld\n", compact);
+			printf("  Traverse x%d:   %ld scattered, %ld compacted\n",
+			       TRAVERSE_PASSES, scattered, compacted);
+			printf("  Total:          %ld without, %ld with compaction\n",
+			       sort + scattered, sort + compact + compacted);
+			printf("  List is %s\n",
+			       check_list(&testdata_head, nums, !test->unstable) ? "sorted" :
+								  "not sorted");
+		}
+		free(offsets);
+	}
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Size of the largest cache cpu0 lists in sysfs, usually the LLC */
+static size_t llc_size(void)
+{
+	size_t llc = 0;
+
+	for (int i = 0;; i++) {
+		char path[64];
+		size_t size;
+		char unit = 0;
+		FILE *f;
+
+		snprintf(path, sizeof(path),
+			 "/sys/devices/system/cpu/cpu0/cache/index%d/size", i);
+		f = fopen(path, "r");
+		if (!f)
+			break;
+		if (fscanf(f, "%zu%c", &size, &unit) >= 1) {
+			size <<= unit == 'K' ? 10 : unit == 'M' ? 20 : 0;
+			if (size > llc)
+				llc = size;
+		}
+		fclose(f);
+	}
+	return llc ? llc : LLC_DEFAULT;
+}
+
+static void flush_range(const void *start, size_t bytes)
+{
+#ifdef HAVE_CLFLUSH
+	for (size_t off = 0; off < bytes; off += CACHE_LINE)
+		_mm_clflush((const char *)start + off);
+	_mm_mfence();
+#endif
+}
+
+/*
+ * Evict @bytes of nodes at @nodes, and their out-of-line keys, from
+ * every cache level.  Without clflush, flushing falls back to streaming.
+ */
+static void evict(enum evict_method method, const void *nodes, size_t bytes,
+		  size_t n)
+{
+	static volatile char *buf;
+	static size_t size;
+
+#ifdef HAVE_CLFLUSH
+	if (method == EVICT_FLUSH) {
+		flush_range(nodes, bytes);
+		if (key_pool)
+			flush_range(key_pool, key_size(key_profile) * n);
+		return;
+	}
+#endif
+	if (!buf) {
+		size = 2 * llc_size();
+		buf = malloc(size);
+	}
+	for (size_t i = 0; i < size; i += CACHE_LINE)
+		buf[i]++;
+}
+
+static void fill_list(struct list_head *head, void *space,
+		      const int *keys, const size_t *slots, size_t n)
+{
+	INIT_LIST_HEAD(head);
+	for (size_t i = 0; i < n; i++) {
+		element_t *elem = elem_at(space, slots ? slots[i] : i);
+		set_val(elem, keys[i]);
+		elem->seq = i;
+		set_key(elem);
+		list_add_tail(&elem->list, head);
+	}
+}
+
+/* A comparison figure of @test in a @width column, or "-" if it has none */
+static void print_cmps(const test_t *test, int width, int prec, double value)
+{
+	if (test->no_cmp)
+		printf("%*s", width, "-");
+	else
+		printf("%*.*f", width, prec, value);
+}
+
+/*
+ * Time one engine at one list size.  Small lists are sorted in batches
+ * so the clock overhead does not swamp the sort itself, and every size
+ * is repeated until SWEEP_MIN_WORK nodes went through the engine.
+ */
+static void sweep_size(test_t *test, const int *keys, void *space,
+		       struct list_head *heads, size_t n, enum layout layout)
+{
+	size_t batch = n < SWEEP_BATCH_NODES ? SWEEP_BATCH_NODES / n : 1;
+	size_t *slots = create_slots(n, layout);
+	uint64_t count = 0, elapsed = 0, sorted = 0;
+	bool ok = true;
+
+	do {
+		uint64_t begin;
+
+		for (size_t b = 0; b < batch; b++)
+			fill_list(&heads[b], elem_at(space, b * n), keys, slots, n);
+		begin = now_ns();
+		for (size_t b = 0; b < batch; b++)
+			test->fp(&count, &heads[b], compare);
+		elapsed += now_ns() - begin;
+		for (size_t b = 0; b < batch; b++)
+			ok &= check_list(&heads[b], n, !test->unstable);
+		sorted += batch * n;
+	} while (sorted < SWEEP_MIN_WORK);
+
+	printf("%-14s %10zu %10.2f ", test->name, n, (double)elapsed / sorted);
+	print_cmps(test, 10, 4, count / (sorted * log2(n)));
+	printf("%s\n", ok ? "" : "  not sorted");
+	free(slots);
+}
+
+/*
+ * Latency of every engine on each list size from 2 to SMALL_MAX.  The
+ * SMALL_LISTS lists of a batch all have different keys, so the branch
+ * predictor cannot learn one input, and the whole batch is timed at
+ * once so the clock does not swamp a sort of a few nodes.
+ */
+static void bench_small(test_t *tests, enum layout layout)
+{
+	void *space = malloc(elem_stride * SMALL_LISTS * SMALL_MAX);
+	struct list_head *heads = malloc(sizeof(*heads) * SMALL_LISTS);
+	int *keys = malloc(sizeof(*keys) * SMALL_LISTS * SMALL_MAX);
+
+	for (size_t i = 0; i < SMALL_LISTS * SMALL_MAX; i++)
+		keys[i] = rand();
+
+	printf("%-20s %6s %10s %10s\n", "algorithm", "nodes", "ns/sort",
+	       "cmp/sort");
+	for (test_t *test = tests; test->fp != NULL; test++) {
+		for (size_t n = 2; n <= SMALL_MAX; n++) {
+			size_t *slots = create_slots(n, layout);
+			uint64_t count = 0, elapsed = 0, sorted = 0;
+			bool ok = true;
+
+			do {
+				uint64_t begin;
+
+				for (size_t b = 0; b < SMALL_LISTS; b++)
+					fill_list(&heads[b],
+						  elem_at(space, b * n),
+						  keys + b * n, slots, n);
+				begin = now_ns();
+				for (size_t b = 0; b < SMALL_LISTS; b++)
+					test->fp(&count, &heads[b], compare);
+				elapsed += now_ns() - begin;
+				for (size_t b = 0; b < SMALL_LISTS; b++)
+					ok &= check_list(&heads[b], n,
+							 !test->unstable);
+				sorted += SMALL_LISTS;
+			} while (sorted < SMALL_MIN_LISTS);
+
+			printf("%-20s %6zu %10.1f ", test->name, n,
+			       (double)elapsed / sorted);
+			print_cmps(test, 10, 1, (double)count / sorted);
+			printf("%s\n", ok ? "" : "  not sorted");
+			free(slots);
+		}
+	}
+
+	free(keys);
+	free(heads);
+	free(space);
+}
+
+/*
+ * Run every engine on sizes from 8 nodes up to @max, visiting each
+ * power of two together with its neighbours 2^k-1 and 2^k+1 (where the
+ * list_sort() merge schedule is most and least balanced) and the
+ * midpoint 3*2^(k-1).  The per-node time shows where each algorithm
+ * falls out of L1, L2, the LLC and the TLB reach.
+ */
+static void bench_sweep(test_t *tests, size_t max, enum layout layout)
+{
+	/* A batch of short lists takes up to SWEEP_BATCH_NODES nodes */
+	void *space = malloc(elem_stride *
+			     (max > SWEEP_BATCH_NODES ? max : SWEEP_BATCH_NODES));
+	struct list_head *heads = malloc(sizeof(*heads) * SWEEP_BATCH_NODES);
+	int *keys = malloc(sizeof(*keys) * max);
+
+	for (size_t i = 0; i < max; i++)
+		keys[i] = rand();
+
+	printf("%-14s %10s %10s %10s\n", "algorithm", "nodes", "ns/node",
+	       "cmp/nlgn");
+	for (size_t p = 8; p <= max; p <<= 1) {
+		size_t sizes[] = { p - 1, p, p + 1, p + p / 2 };
+
+		for (int i = 0; i < 4; i++) {
+			if (sizes[i] < 8 || sizes[i] > max)
+				continue;
+			for (test_t *test = tests; test->fp != NULL; test++)
+				sweep_size(test, keys, space, heads, sizes[i],
+					   layout);
+		}
+	}
+
+	free(keys);
+	free(heads);
+	free(space);
+}
+
+static void gen_random(int *keys, size_t n, size_t param)
+{
+	for (size_t i = 0; i < n; i++)
+		keys[i] = rand();
+}
+
+/* Ascending keys, one in @param replaced by a random key */
+static void gen_noisy(int *keys, size_t n, size_t param)
+{
+	for (size_t i = 0; i < n; i++)
+		keys[i] = rand() % param ? (int)i : rand() % (int)n;
+}
+
+/* Ascending runs of @param random keys each */
+static void gen_runs(int *keys, size_t n, size_t param)
+{
+	for (size_t i = 0; i < n; i++)
+		keys[i] = i % param ? keys[i - 1] + rand() % 8 : rand() / 2;
+}
+
+/* Random keys out of @param distinct values */
+static void gen_few(int *keys, size_t n, size_t param)
+{
+	for (size_t i = 0; i < n; i++)
+		keys[i] = rand() % param;
+}
+
+/*
+ * Synthetic inputs of known shape.  Each one is also used in reverse
+ * (negated keys), which turns its ascending runs into descending ones.
+ */
+static const struct workload {
+	const char *name;
+	void (*gen)(int *keys, size_t n, size_t param);
+	size_t param;
+} workloads[] = {
+	{ "random", gen_random, 0 },
+	{ "noisy-1/2", gen_noisy, 2 },
+	{ "noisy-1/8", gen_noisy, 8 },
+	{ "noisy-1/64", gen_noisy, 64 },
+	{ "noisy-1/1024", gen_noisy, 1024 },
+	{ "runs-4", gen_runs, 4 },
+	{ "runs-16", gen_runs, 16 },
+	{ "runs-64", gen_runs, 64 },
+	{ "runs-1024", gen_runs, 1024 },
+	{ "sorted", gen_runs, SIZE_MAX },
+	{ "keys-4", gen_few, 4 },
+	{ "keys-32", gen_few, 32 },
+	{ "keys-1024", gen_few, 1024 },
+	{ NULL, NULL, 0 },
+};
+
+static void gen_workload(int *keys, size_t n, const struct workload *w,
+			 bool reversed)
+{
+	w->gen(keys, n, w->param);
+	if (reversed)
+		for (size_t i = 0; i < n; i++)
+			keys[i] = -keys[i];
+}
+
+/*
+ * Look up a workload by name, with an optional "reversed-" prefix as
+ * the suite prints it.  Returns NULL if there is none.
+ */
+static const struct workload *find_workload(const char *name, bool *reversed)
+{
+	*reversed = !strncmp(name, "reversed-", 9);
+	if (*reversed)
+		name += 9;
+	for (const struct workload *w = workloads; w->name; w++)
+		if (!strcmp(name, w->name))
+			return w;
+	return NULL;
+}
+
+/*
+ * Trace file layout, in native byte order: this header, the keys as
+ * int32_t in input order and, with TRACE_SIZES, the element sizes in
+ * bytes as uint32_t.  It is read through mmap() and used in place.
+ */
+#define TRACE_MAGIC "LSTRACE1"
+#define TRACE_SIZES 0x1
+
+struct trace_header {
+	char magic[8];
+	uint32_t flags;
+	uint32_t reserved;
+	uint64_t count;
+};
+
+struct trace {
+	const int32_t *keys;
+	const uint32_t *sizes;	/* NULL if the trace has none */
+	size_t count;
+	void *map;
+	size_t len;
+};
+
+/* Map the trace at @path into @t; returns 0, or -1 with a message */
+static int trace_open(struct trace *t, const char *path)
+{
+	const struct trace_header *h;
+	struct stat st;
+	size_t words;
+	int fd = open(path, O_RDONLY);
+
+	if (fd < 0 || fstat(fd, &st) < 0) {
+		perror(path);
+		if (fd >= 0)
+			close(fd);
+		return -1;
+	}
+	t->len = st.st_size;
+	t->map = t->len ? mmap(NULL, t->len, PROT_READ, MAP_PRIVATE, fd, 0) :
+			  MAP_FAILED;
+	close(fd);
+	if (t->map == MAP_FAILED) {
+		fprintf(stderr, "%s: cannot map\n", path);
+		return -1;
+	}
+
+	h = t->map;
+	words = t->len >= sizeof(*h) && h->flags & TRACE_SIZES ? 2 : 1;
+	if (t->len < sizeof(*h) ||
+	    memcmp(h->magic, TRACE_MAGIC, sizeof(h->magic)) ||
+	    (h->flags & ~TRACE_SIZES) || !h->count ||
+	    (t->len - sizeof(*h)) / (words * sizeof(uint32_t)) != h->count ||
+	    (t->len - sizeof(*h)) % (words * sizeof(uint32_t))) {
+		fprintf(stderr, "%s: not a trace file\n", path);
+		munmap(t->map, t->len);
+		return -1;
+	}
+	t->count = h->count;
+	t->keys = (const int32_t *)(h + 1);
+	t->sizes = words == 2 ? (const uint32_t *)(t->keys + t->count) : NULL;
+	return 0;
+}
+
+static void trace_close(struct trace *t)
+{
+	if (t->map)
+		munmap(t->map, t->len);
+}
+
+/* Write @n keys, and @sizes unless NULL, to @path as a trace */
+static int trace_save(const char *path, const int *keys,
+		      const uint32_t *sizes, size_t n)
+{
+	struct trace_header h = {
+		.magic = TRACE_MAGIC,
+		.flags = sizes ? TRACE_SIZES : 0,
+		.count = n,
+	};
+	FILE *f = fopen(path, "wb");
+	bool ok;
+
+	if (!f) {
+		perror(path);
+		return -1;
+	}
+	ok = fwrite(&h, sizeof(h), 1, f) == 1 &&
+	     fwrite(keys, sizeof(*keys), n, f) == n &&
+	     (!sizes || fwrite(sizes, sizeof(*sizes), n, f) == n);
+	if (fclose(f) || !ok) {
+		fprintf(stderr, "%s: write failed\n", path);
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Time every candidate engine on every workload, file the result under
+ * the bucket that list_sort_sample() puts the workload in, and print the
+ * fastest engine per bucket as list_sort_auto_table.h.  Buckets that no
+ * workload falls into keep list_sort().
+ */
+static void gen_auto_table(size_t n)
+{
+	static const test_t candidates[] = {
+		{ list_sort, "list_sort" },
+		{ list_sort_runs, "list_sort_runs" },
+		{ shiverssort, "shiverssort" },
+		{ timsort, "timsort" },
+	};
+	enum { NR_CANDIDATES = sizeof(candidates) / sizeof(candidates[0]) };
+	static uint64_t cost[LIST_SORT_AUTO_BUCKETS][LIST_SORT_AUTO_BUCKETS]
+			    [NR_CANDIDATES];
+	static bool seen[LIST_SORT_AUTO_BUCKETS][LIST_SORT_AUTO_BUCKETS];
+	void *space = malloc(elem_stride * n);
+	int *keys = malloc(sizeof(*keys) * n);
+	struct list_sort_sample sample;
+	struct list_head head;
+
+	for (const struct workload *w = workloads; w->name; w++) {
+		for (int reversed = 0; reversed < 2; reversed++) {
+			gen_workload(keys, n, w, reversed);
+			fill_list(&head, space, keys, NULL, n);
+			if (!list_sort_sample(NULL, &head, compare, &sample))
+				continue;
+			fprintf(stderr, "%s%s: run bucket %u, inversion bucket %u\n",
+				reversed ? "reversed " : "", w->name,
+				sample.run_bucket, sample.inv_bucket);
+			seen[sample.run_bucket][sample.inv_bucket] = true;
+
+			for (int c = 0; c < NR_CANDIDATES; c++) {
+				uint64_t begin;
+
+				fill_list(&head, space, keys, NULL, n);
+				begin = now_ns();
+				candidates[c].fp(NULL, &head, compare);
+				cost[sample.run_bucket][sample.inv_bucket][c] +=
+					now_ns() - begin;
+			}
+		}
+	}
+
+	printf("/* SPDX-License-Identifier: GPL-2.0 */\n"
+	       "/* Generated by \"./main -t\"; regenerate with \"make auto-table\". */\n"
+	       "#pragma once\n\n"
+	       "static const list_sort_func_t\n"
+	       "list_sort_auto_table[LIST_SORT_AUTO_BUCKETS][LIST_SORT_AUTO_BUCKETS] = {\n");
+	for (int r = 0; r < LIST_SORT_AUTO_BUCKETS; r++) {
+		printf("\t{ ");
+		for (int i = 0; i < LIST_SORT_AUTO_BUCKETS; i++) {
+			int best = 0;
+
+			for (int c = 1; seen[r][i] && c < NR_CANDIDATES; c++)
+				if (cost[r][i][c] < cost[r][i][best])
+					best = c;
+			printf("%s%s", candidates[best].name,
+			       i < LIST_SORT_AUTO_BUCKETS - 1 ? ", " : " },\n");
+		}
+	}
+	printf("};\n");
+
+	free(keys);
+	free(space);
+}
+
+static void print_ratio(uint64_t count, double bound)
+{
+	if (bound > 0)
+		printf(" %10.3f", count / bound);
+	else
+		printf(" %10s", "-");
+}
+
+/*
+ * For every workload, report how presorted it is and how far each
+ * engine's comparison count is from the log2(n!) and n*H lower bounds.
+ */
+static void bench_presort(test_t *tests, size_t n)
+{
+	void *space = malloc(elem_stride * n);
+	int *keys = malloc(sizeof(*keys) * n);
+	struct list_presortedness p;
+	struct list_head head;
+
+	for (const struct workload *w = workloads; w->name; w++) {
+		for (int reversed = 0; reversed < 2; reversed++) {
+			gen_workload(keys, n, w, reversed);
+			fill_list(&head, space, keys, NULL, n);
+			list_presortedness(NULL, &head, compare, &p);
+
+			printf("==== %s%s ====\n", reversed ? "reversed " : "",
+			       w->name);
+			printf("  Runs:           %zu\n", p.runs);
+			printf("  Run entropy H:  %.3f bits\n", p.entropy);
+			printf("  Inversions:     %.4g (%.2f%% of pairs)\n",
+			       p.inversions,
+			       200 * p.inversions / ((double)n * (n - 1)));
+			printf("  log2(n!):       %.0f\n", p.lg_nfact);
+			printf("  n*H:            %.0f\n", p.nh);
+			printf("  %-16s %12s %10s %10s\n", "algorithm",
+			       "comparisons", "/log2(n!)", "/n*H");
+
+			for (test_t *test = tests; test->fp != NULL; test++) {
+				uint64_t count = 0;
+
+				fill_list(&head, space, keys, NULL, n);
+				test->fp(&count, &head, compare);
+				printf("  %-16s ", test->name);
+				print_cmps(test, 12, 0, count);
+				print_ratio(count, test->no_cmp ? 0 : p.lg_nfact);
+				print_ratio(count, test->no_cmp ? 0 : p.nh);
+				printf("%s\n", check_list(&head, n, !test->unstable) ? "" :
+								      "  not sorted");
+			}
+		}
+	}
+
+	free(keys);
+	free(space);
+}
+
+/*
+ * One entry of the baseline suite.  Entries are matched on the host
+ * fingerprint and the key "algorithm workload nodes layout profile";
+ * time is ns/node over @reps passes, comparisons are from one run and
+ * are exact, since the inputs are regenerated from BENCH_SEED.
+ */
+struct bench_result {
+	char host[17];
+	char key[256];	/* Fits the widest fields load_baseline() reads */
+	unsigned int reps;
+	double mean, stddev;
+	uint64_t cmps;
+};
+
+/*
+ * Identify the machine and build: results only compare meaningfully
+ * on the same CPU model, CPU count, compiler and build configuration.
+ * The FNV-1a hash of those keeps the baseline file one token per field.
+ */
+static void host_fingerprint(char *buf, size_t size)
+{
+	char line[256], desc[512] = "";
+	uint64_t hash = 0xcbf29ce484222325;
+	FILE *f = fopen("/proc/cpuinfo", "r");
+
+	if (f) {
+		while (fgets(line, sizeof(line), f))
+			if (!strncmp(line, "model name", 10)) {
+				strncat(desc, line, sizeof(desc) - 1);
+				break;
+			}
+		fclose(f);
+	}
+	snprintf(desc + strlen(desc), sizeof(desc) - strlen(desc),
+		 "%ld %s", sysconf(_SC_NPROCESSORS_ONLN), __VERSION__);
+	/* Only matrix builds add their flags, so old baselines still match */
+	if (*BUILD_CONFIG)
+		snprintf(desc + strlen(desc), sizeof(desc) - strlen(desc),
+			 " %s", BUILD_CONFIG);
+
+	for (const char *c = desc; *c; c++)
+		hash = (hash ^ (unsigned char)*c) * 0x100000001b3;
+	snprintf(buf, size, "%016" PRIx64, hash);
+}
+
+/*
+ * Run every engine on every workload, forwards and reversed.  Returns
+ * the results in a new array and their number in *@nr.
+ *
+ * The suite is run BENCH_PASSES times over, timing each entry once per
+ * pass, with the nodes allocated afresh for every pass.  The spread of
+ * an entry is then the one between timings minutes apart and on other
+ * physical pages, close to what separates two runs of the program,
+ * rather than that of back-to-back repetitions, which is far smaller.
+ */
+static struct bench_result *bench_suite(test_t *tests, size_t n,
+					enum layout layout, size_t *nr)
+{
+	int *keys = malloc(sizeof(*keys) * n);
+	size_t *slots = create_slots(n, layout);
+	struct bench_result *results;
+	size_t nr_tests = 0, nr_workloads = 0, nr_results;
+	double *sum, *sum2;
+	struct list_head head;
+	char host[17];
+
+	while (tests[nr_tests].fp)
+		nr_tests++;
+	while (workloads[nr_workloads].name)
+		nr_workloads++;
+	nr_results = nr_tests * nr_workloads * 2;
+	results = malloc(sizeof(*results) * nr_results);
+	sum = calloc(nr_results, sizeof(*sum));
+	sum2 = calloc(nr_results, sizeof(*sum2));
+	host_fingerprint(host, sizeof(host));
+
+	for (int pass = 0; pass < BENCH_PASSES; pass++) {
+		void *space = malloc(elem_stride * n);
+		struct bench_result *r = results;
+
+		for (const struct workload *w = workloads; w->name; w++) {
+			for (int reversed = 0; reversed < 2; reversed++) {
+				srand(BENCH_SEED);
+				gen_workload(keys, n, w, reversed);
+
+				for (test_t *test = tests; test->fp; test++, r++) {
+					uint64_t elapsed = 0, sorted = 0;
+					double t;
+
+					memcpy(r->host, host, sizeof(host));
+					snprintf(r->key, sizeof(r->key),
+						 "%s %s%s %zu %s %s", test->name,
+						 reversed ? "reversed-" : "",
+						 w->name, n, layout_names[layout],
+						 key_profiles[key_profile].name);
+					/* Warm up */
+					fill_list(&head, space, keys, slots, n);
+					test->fp(NULL, &head, compare);
+					do {
+						uint64_t count = 0, begin;
+
+						fill_list(&head, space, keys, slots, n);
+						begin = now_ns();
+						test->fp(&count, &head, compare);
+						elapsed += now_ns() - begin;
+						sorted += n;
+						r->cmps = count;
+					} while (sorted < BENCH_MIN_WORK);
+					if (!check_list(&head, n, !test->unstable))
+						fprintf(stderr, "%s: not sorted\n",
+							r->key);
+					t = (double)elapsed / sorted;
+					sum[r - results] += t;
+					sum2[r - results] += t * t;
+				}
+			}
+		}
+		free(space);
+	}
+
+	for (size_t i = 0; i < nr_results; i++) {
+		struct bench_result *r = &results[i];
+
+		r->reps = BENCH_PASSES;
+		r->mean = sum[i] / BENCH_PASSES;
+		r->stddev = sqrt(fmax(0, (sum2[i] - sum[i] * r->mean) /
+					    (BENCH_PASSES - 1)));
+	}
+
+	free(sum2);
+	free(sum);
+	free(slots);
+	free(keys);
+	*nr = nr_results;
+	return results;
+}
+
+/*
+ * Read the baseline file into a new array of up to @extra more entries
+ * than it holds.  A missing file is an empty baseline.
+ */
+static struct bench_result *load_baseline(const char *path, size_t extra,
+					  size_t *nr)
+{
+	struct bench_result *base = NULL, r;
+	char line[512], algo[64], workload[64], lay[32], prof[32];
+	size_t alloc = 0, nodes;
+	FILE *f = fopen(path, "r");
+
+	*nr = 0;
+	while (f && fgets(line, sizeof(line), f)) {
+		if (line[0] == '#')
+			continue;
+		if (sscanf(line, "%16s %63s %63s %zu %31s %31s %u %lf %lf %" SCNu64,
+			   r.host, algo, workload, &nodes, lay, prof, &r.reps,
+			   &r.mean, &r.stddev, &r.cmps) != 10)
+			continue;
+		snprintf(r.key, sizeof(r.key), "%s %s %zu %s %s", algo,
+			 workload, nodes, lay, prof);
+		if (*nr == alloc) {
+			alloc = alloc ? 2 * alloc : 256;
+			base = realloc(base, sizeof(*base) * alloc);
+		}
+		base[(*nr)++] = r;
+	}
+	if (f)
+		fclose(f);
+	return realloc(base, sizeof(*base) * (*nr + extra + 1));
+}
+
+static struct bench_result *find_result(struct bench_result *base, size_t nr,
+					const struct bench_result *r)
+{
+	for (size_t i = 0; i < nr; i++)
+		if (!strcmp(base[i].host, r->host) && !strcmp(base[i].key, r->key))
+			return &base[i];
+	return NULL;
+}
+
+/*
+ * Run the suite and merge the results into the baseline at @path,
+ * replacing the entries with the same host and key and keeping the
+ * rest, so one file can hold several machines and sizes.
+ */
+static int bench_save(test_t *tests, size_t n, enum layout layout,
+		      const char *path)
+{
+	size_t nr_results, nr;
+	struct bench_result *results = bench_suite(tests, n, layout,
+						   &nr_results);
+	struct bench_result *base = load_baseline(path, nr_results, &nr);
+	FILE *f;
+
+	for (size_t i = 0; i < nr_results; i++) {
+		struct bench_result *old = find_result(base, nr, &results[i]);
+
+		*(old ? old : &base[nr++]) = results[i];
+	}
+
+	f = fopen(path, "w");
+	if (!f) {
+		perror(path);
+		return 1;
+	}
+	fprintf(f, "# host algorithm workload nodes layout profile reps "
+		   "ns/node stddev comparisons\n");
+	for (size_t i = 0; i < nr; i++)
+		fprintf(f, "%s %s %u %.4f %.4f %" PRIu64 "\n", base[i].host,
+			base[i].key, base[i].reps, base[i].mean,
+			base[i].stddev, base[i].cmps);
+	fclose(f);
+	printf("Saved %zu results to %s\n", nr_results, path);
+
+	free(base);
+	free(results);
+	return 0;
+}
+
+/*
+ * Run the suite and compare it with the baseline at @path.  More
+ * comparisons than the baseline is always a regression, since the
+ * inputs are identical.  A slower time is one only if it exceeds
+ * BENCH_TOLERANCE and Welch's t statistic exceeds BENCH_T_CRIT.  The
+ * standard deviations are those between bench_suite() passes, so the
+ * test is against run to run noise, not that of repetitions within a
+ * pass.  Returns nonzero on any regression.
+ */
+static int bench_compare(test_t *tests, size_t n, enum layout layout,
+			 const char *path)
+{
+	size_t nr_results, nr;
+	struct bench_result *results = bench_suite(tests, n, layout,
+						   &nr_results);
+	struct bench_result *base = load_baseline(path, 0, &nr);
+	int regressions = 0, missing = 0;
+
+	printf("%-52s %10s %10s %8s %6s\n", "benchmark", "base ns", "ns/node",
+	       "change", "t");
+	for (size_t i = 0; i < nr_results; i++) {
+		const struct bench_result *r = &results[i];
+		const struct bench_result *old = find_result(base, nr, r);
+		double change, se, t;
+		bool slower, faster;
+
+		if (!old) {
+			missing++;
+			continue;
+		}
+		change = r->mean / old->mean - 1;
+		se = sqrt(r->stddev * r->stddev / r->reps +
+			  old->stddev * old->stddev / old->reps);
+		t = se > 0 ? (r->mean - old->mean) / se : 0;
+		slower = change > BENCH_TOLERANCE && (se == 0 || t > BENCH_T_CRIT);
+		faster = change < -BENCH_TOLERANCE &&
+			 (se == 0 || t < -BENCH_T_CRIT);
+		printf("%-52s %10.2f %10.2f %+7.1f%% %6.1f%s\n", r->key,
+		       old->mean, r->mean, 100 * change, t,
+		       slower ? "  SLOWER" : faster ? "  faster" : "");
+		if (r->cmps > old->cmps)
+			printf("%-52s comparisons %" PRIu64 " -> %" PRIu64
+			       "  MORE COMPARISONS\n", r->key, old->cmps, r->cmps);
+		regressions += slower || r->cmps > old->cmps;
+	}
+
+	if (missing)
+		printf("%d results have no baseline for this host\n", missing);
+	printf("%d regressions\n", regressions);
+
+	free(base);
+	free(results);
+	return regressions ? 1 : 0;
+}
+
+/* One sorting thread of the throughput mode, with its own nodes */
+struct instance {
+	const test_t *test;
+	void *space;
+	const size_t *slots;
+	size_t n;
+	pthread_barrier_t *start;
+	uint64_t sorts, busy_ns, max_ns, wall_ns;
+};
+
+static void *throughput_worker(void *arg)
+{
+	struct instance *in = arg;
+	struct list_head head;
+	uint64_t start, end;
+
+	in->sorts = in->busy_ns = in->max_ns = 0;
+	pthread_barrier_wait(in->start);
+	start = now_ns();
+
+	do {
+		uint64_t count = 0, begin, elapsed;
+
+		/* Relink the nodes in input order; keys were set up front */
+		INIT_LIST_HEAD(&head);
+		for (size_t i = 0; i < in->n; i++)
+			list_add_tail(&elem_at(in->space,
+					       in->slots ? in->slots[i] : i)->list,
+				      &head);
+		begin = now_ns();
+		in->test->fp(&count, &head, compare);
+		elapsed = now_ns() - begin;
+
+		in->sorts++;
+		in->busy_ns += elapsed;
+		if (elapsed > in->max_ns)
+			in->max_ns = elapsed;
+		end = now_ns();
+	} while (end - start < THROUGHPUT_NS);
+
+	in->wall_ns = end - start;
+	return NULL;
+}
+
+/*
+ * Run 1, 2, 4, ... up to @max_threads instances of every engine at the
+ * same time, each sorting its own list of @n nodes over and over, and
+ * report the aggregate throughput and the per-sort latency.  Since the
+ * instances share the LLC and the memory bandwidth, the drop in
+ * throughput per instance shows how each engine copes with contention.
+ *
+ * Throughput is all sorts over the longest instance's wall time, which
+ * includes the O(n) relinking between sorts; the latencies are of the
+ * sorts alone.  With more instances than CPUs, latency includes time
+ * spent preempted.
+ */
+static void bench_throughput(test_t *tests, size_t n, int max_threads,
+			     enum layout layout)
+{
+	struct instance *in = calloc(max_threads, sizeof(*in));
+	pthread_t *threads = malloc(sizeof(*threads) * max_threads);
+	size_t *slots = create_slots(n, layout);
+	int *keys = malloc(sizeof(*keys) * n);
+	pthread_barrier_t start;
+	struct list_head head;
+
+	for (size_t i = 0; i < n; i++)
+		keys[i] = rand();
+	/* Every instance sorts the same keys, so set_key() agrees on them */
+	for (int t = 0; t < max_threads; t++) {
+		in[t].space = malloc(elem_stride * n);
+		in[t].slots = slots;
+		in[t].n = n;
+		fill_list(&head, in[t].space, keys, slots, n);
+	}
+
+	printf("%-20s %8s %12s %12s %12s %10s\n", "algorithm", "threads",
+	       "sorts/s", "mean ms", "max ms", "scaling");
+	for (test_t *test = tests; test->fp != NULL; test++) {
+		double single = 0;
+
+		for (int nr = 1; nr <= max_threads; nr *= 2) {
+			uint64_t sorts = 0, busy = 0, max_ns = 0, wall = 0;
+			double rate;
+
+			pthread_barrier_init(&start, NULL, nr);
+			for (int t = 0; t < nr; t++) {
+				in[t].test = test;
+				in[t].start = &start;
+				pthread_create(&threads[t], NULL, throughput_worker,
+					       &in[t]);
+			}
+			for (int t = 0; t < nr; t++) {
+				pthread_join(threads[t], NULL);
+				sorts += in[t].sorts;
+				busy += in[t].busy_ns;
+				if (in[t].max_ns > max_ns)
+					max_ns = in[t].max_ns;
+				if (in[t].wall_ns > wall)
+					wall = in[t].wall_ns;
+			}
+			pthread_barrier_destroy(&start);
+			rate = sorts * 1e9 / wall;
+
+			if (nr == 1)
+				single = rate;
+			printf("%-20s %8d %12.2f %12.3f %12.3f %9.0f%%\n",
+			       test->name, nr, rate, busy / 1e6 / sorts,
+			       max_ns / 1e6, 100 * rate / (single * nr));
+		}
+	}
+
+	for (int t = 0; t < max_threads; t++)
+		free(in[t].space);
+	free(keys);
+	free(slots);
+	free(threads);
+	free(in);
+}
+
+/* One engine run in stack mode */
+struct stack_run {
+	const test_t *test;	/* NULL for an empty run */
+	struct list_head *head;
+	uint64_t count, elapsed_ns;
+};
+
+static void *stack_worker(void *arg)
+{
+	struct stack_run *run = arg;
+	uint64_t begin = now_ns();
+
+	/* An empty run still reads the clock, so it uses the same frames */
+	if (run->test)
+		run->test->fp(&run->count, run->head, compare);
+	run->elapsed_ns = now_ns() - begin;
+	return NULL;
+}
+
+/*
+ * Do @run on a thread whose stack is @stack, painted with STACK_PAINT
+ * first, and return how many bytes of it were written.  The stack
+ * grows down, so that is everything above the lowest changed byte.
+ */
+static size_t stack_used(struct stack_run *run, unsigned char *stack)
+{
+	pthread_attr_t attr;
+	pthread_t thread;
+	size_t low = 0;
+
+	memset(stack, STACK_PAINT, STACK_BYTES);
+	pthread_attr_init(&attr);
+	pthread_attr_setstack(&attr, stack, STACK_BYTES);
+	pthread_create(&thread, &attr, stack_worker, run);
+	pthread_join(thread, NULL);
+	pthread_attr_destroy(&attr);
+
+	while (low < STACK_BYTES && stack[low] == STACK_PAINT)
+		low++;
+	return STACK_BYTES - low;
+}
+
+/*
+ * Sort every workload of @n nodes once with every engine, each on a
+ * fresh thread, and report the time and the peak stack use of the sort.
+ * The stack taken by an empty thread (the start routine and the clock
+ * reads) is measured first and subtracted, so what is left is the
+ * engine's own frames: its recursion and its on-stack arrays.
+ */
+static void bench_stack(test_t *tests, size_t n, enum layout layout)
+{
+	unsigned char *stack = aligned_alloc(sysconf(_SC_PAGESIZE), STACK_BYTES);
+	void *space = malloc(elem_stride * n);
+	int *keys = malloc(sizeof(*keys) * n);
+	size_t *slots = create_slots(n, layout);
+	struct stack_run run = { NULL };
+	struct list_head head;
+	size_t base;
+
+	/* The first run also pays for binding the symbols it calls */
+	stack_used(&run, stack);
+	base = stack_used(&run, stack);
+
+	printf("%-22s %-20s %10s %12s %10s\n", "workload", "algorithm", "ms",
+	       "comparisons", "stack");
+	for (const struct workload *w = workloads; w->name; w++) {
+		for (int reversed = 0; reversed < 2; reversed++) {
+			char name[64];
+
+			snprintf(name, sizeof(name), "%s%s",
+				 reversed ? "reversed-" : "", w->name);
+			gen_workload(keys, n, w, reversed);
+			for (test_t *test = tests; test->fp != NULL; test++) {
+				size_t used;
+
+				fill_list(&head, space, keys, slots, n);
+				run = (struct stack_run){ test, &head };
+				used = stack_used(&run, stack);
+				printf("%-22s %-20s %10.3f ", name, test->name,
+				       run.elapsed_ns / 1e6);
+				print_cmps(test, 12, 0, run.count);
+				printf(" %10zu%s\n", used > base ? used - base : 0,
+				       check_list(&head, n, !test->unstable) ?
+				       "" : "  not sorted");
+			}
+		}
+	}
+
+	free(slots);
+	free(keys);
+	free(space);
+	free(stack);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [-c | -p | -s | -S | -L | -t | -b file | -B file |\n"
+		"       -m threads]\n"
+		"       [-j threads] [-k profile] [-l layout] [-n nodes]\n"
+		"       [-g workload | -r trace] [-w trace] [-C method]\n"
+		"       [-e stride] [-o offset] [-P distance]\n"
+		"  -b file    run the benchmark suite and save it as the baseline\n"
+		"  -B file    run the benchmark suite, compare it with the baseline\n"
+		"             and exit nonzero on a regression\n"
+		"  -c         time sort+compact+traverse against sort+traverse\n"
+		"  -m threads run 1, 2, 4, ... up to this many sorting threads\n"
+		"             at once and report throughput and latency\n"
+		"  -p         report presortedness and lower bounds per workload\n"
+		"  -s         sweep list sizes from 8 nodes up to -n nodes\n"
+		"  -S         report time and peak stack use per workload\n"
+		"  -L         report the latency of each list size from 2 to %d\n"
+		"  -t         print list_sort_auto_table.h from -n node workloads\n"
+		"  -j threads threads for list_sort_parallel (default: all CPUs)\n"
+		"  -k profile key and comparator: int (default), ptr, str, tuple\n"
+		"             or latency\n"
+		"  -l layout  node placement: sequential (default) or shuffled\n"
+		"  -n nodes   list size (default %d; sweep default 2^27)\n"
+		"  -g name    generate the sample as this workload, e.g. runs-16\n"
+		"             or reversed-keys-4, instead of random keys\n"
+		"  -r trace   replay the keys, and element sizes if any, of a trace\n"
+		"             file; its length overrides -n\n"
+		"  -w trace   save the sample keys as a trace file\n"
+		"  -C method  also time each engine with its nodes evicted from\n"
+		"             the caches first: flush (clflush every line) or\n"
+		"             stream (write a buffer twice the LLC size)\n"
+		"  -e stride  bytes per node, at least sizeof(element_t) (%zu)\n"
+		"  -o offset  place the int key this many bytes after the\n"
+		"             list_head, past the element_t header; the node\n"
+		"             grows to fit it\n"
+		"  -P distance nodes ahead timsort_prefetch prefetches\n"
+		"             (default %d)\n",
+		prog, SMALL_MAX, SAMPLES, sizeof(element_t), PREFETCH_DISTANCE);
+}
+
+int main(int argc, char *argv[])
 {
 	struct list_head sample_head, warmdata_head, testdata_head;
 	element_t *samples, *warmdata, *testdata;
-	int count;
-	int nums = SAMPLES;
+	uint64_t count;
+	size_t nums = SAMPLES;
+	enum layout layout = LAYOUT_SEQUENTIAL;
+	enum mode mode = MODE_DEFAULT;
+	size_t sweep_max = SWEEP_MAX;
+	const char *baseline = NULL;
+	const char *trace_in = NULL, *trace_out = NULL;
+	const struct workload *workload = NULL;
+	enum evict_method evict_method = EVICT_NONE;
+	bool reversed = false;
+	struct trace trace = { NULL };
+	const int *sample_keys;
+	int *keys = NULL;
+	int instances = 0;
+	size_t *offsets, bytes;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "b:B:cC:e:g:j:k:l:Lm:o:pP:r:sSn:tw:")) != -1) {
+		switch (opt) {
+		case 'C':
+			for (evict_method = EVICT_FLUSH;
+			     evict_method < NR_EVICT_METHODS; evict_method++)
+				if (!strcmp(optarg, evict_names[evict_method]))
+					break;
+			if (evict_method == NR_EVICT_METHODS) {
+				usage(argv[0]);
+				return 1;
+			}
+			break;
+		case 'e':
+			elem_stride = strtoull(optarg, NULL, 0);
+			if (elem_stride < sizeof(element_t)) {
+				usage(argv[0]);
+				return 1;
+			}
+			break;
+		case 'o':
+			key_offset = strtoll(optarg, NULL, 0);
+			if ((key_offset != KEY_OFFSET_DEFAULT &&
+			     key_offset < (ptrdiff_t)sizeof(element_t)) ||
+			    key_offset % sizeof(int)) {
+				usage(argv[0]);
+				return 1;
+			}
+			break;
+		case 'g':
+			workload = find_workload(optarg, &reversed);
+			if (!workload) {
+				usage(argv[0]);
+				return 1;
+			}
+			break;
+		case 'r':
+			trace_in = optarg;
+			break;
+		case 'w':
+			trace_out = optarg;
+			break;
+		case 'b':
+			mode = MODE_BASELINE;
+			baseline = optarg;
+			break;
+		case 'B':
+			mode = MODE_COMPARE;
+			baseline = optarg;
+			break;
+		case 'c':
+			mode = MODE_COMPACT;
+			break;
+		case 'm':
+			mode = MODE_THROUGHPUT;
+			instances = atoi(optarg);
+			if (instances <= 0) {
+				usage(argv[0]);
+				return 1;
+			}
+			break;
+		case 'p':
+			mode = MODE_PRESORT;
+			break;
+		case 's':
+			mode = MODE_SWEEP;
+			break;
+		case 'S':
+			mode = MODE_STACK;
+			break;
+		case 'L':
+			mode = MODE_SMALL;
+			break;
+		case 't':
+			mode = MODE_AUTO_TABLE;
+			break;
+		case 'n':
+			nums = sweep_max = strtoull(optarg, NULL, 0);
+			if (nums == 0) {
+				usage(argv[0]);
+				return 1;
+			}
+			break;
+		case 'j':
+			parallel_threads = atoi(optarg);
+			break;
+		case 'P':
+			prefetch_distance = atoi(optarg);
+			if (prefetch_distance < 0) {
+				usage(argv[0]);
+				return 1;
+			}
+			break;
+		case 'k':
+			for (key_profile = 0; key_profile < NR_KEY_PROFILES;
+			     key_profile++)
+				if (!strcmp(optarg, key_profiles[key_profile].name))
+					break;
+			if (key_profile == NR_KEY_PROFILES) {
+				usage(argv[0]);
+				return 1;
+			}
+			compare = key_profiles[key_profile].cmp;
+			break;
+		case 'l':
+			for (layout = 0; layout < NR_LAYOUTS; layout++)
+				if (!strcmp(optarg, layout_names[layout]))
+					break;
+			if (layout == NR_LAYOUTS) {
+				usage(argv[0]);
+				return 1;
+			}
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (parallel_threads <= 0)
+		parallel_threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+	/* A moved key needs the int profile, and room in the node */
+	if (key_offset != KEY_OFFSET_DEFAULT) {
+		if (key_profile != KEY_INT) {
+			usage(argv[0]);
+			return 1;
+		}
+		compare = compare_offset;
+		if (elem_stride < key_offset + sizeof(int))
+			elem_stride = key_offset + sizeof(int);
+	}
+	elem_stride = (elem_stride + _Alignof(element_t) - 1) &
+		      ~(_Alignof(element_t) - 1);
+
+	/* A replayed trace sets the sample size */
+	if (trace_in) {
+		if (trace_open(&trace, trace_in))
+			return 1;
+		nums = trace.count;
+	}
 
 	srand(1050);
 
+	key_pool = malloc(key_size(key_profile) *
+			  (mode == MODE_SWEEP ? sweep_max : nums));
+
 	test_t tests[] = {
 			   { list_sort, "list_sort" },
 			   { list_sort_old, "list_sort_old" },
+			   { list_sort_runs, "list_sort_runs" },
+			   { list_sort_4way, "list_sort_4way" },
+			   { list_sort_net, "list_sort_net" },
+			   { list_sort_lowcard, "list_sort_lowcard" },
+			   { list_sort_unstable, "list_sort_unstable", true },
+			   { list_sort_cache, "list_sort_cache" },
+			   { list_sort_small, "list_sort_small" },
+			   { list_sort_auto, "list_sort_auto" },
+			   { parallel_sort, "list_sort_parallel", false, true },
 			   { shiverssort, "shiverssort" },
 			   { timsort, "timsort" },
+			   { prefetch_sort, "timsort_prefetch" },
+			   { key_sort, "timsort_key", false, true },
 			   { NULL, NULL } },
 	       *test = tests;
 
+	if (mode == MODE_SWEEP) {
+		bench_sweep(tests, sweep_max, layout);
+		return 0;
+	}
+	if (mode == MODE_AUTO_TABLE) {
+		gen_auto_table(nums);
+		return 0;
+	}
+	if (mode == MODE_PRESORT) {
+		bench_presort(tests, nums);
+		return 0;
+	}
+	if (mode == MODE_THROUGHPUT) {
+		bench_throughput(tests, nums, instances, layout);
+		return 0;
+	}
+	if (mode == MODE_SMALL) {
+		bench_small(tests, layout);
+		return 0;
+	}
+	if (mode == MODE_STACK) {
+		bench_stack(tests, nums, layout);
+		return 0;
+	}
+	if (mode == MODE_BASELINE)
+		return bench_save(tests, nums, layout, baseline);
+	if (mode == MODE_COMPARE)
+		return bench_compare(tests, nums, layout, baseline);
+
 	INIT_LIST_HEAD(&sample_head);
 
-	samples = malloc(sizeof(*samples) * SAMPLES);
-	warmdata = malloc(sizeof(*warmdata) * SAMPLES);
-	testdata = malloc(sizeof(*testdata) * SAMPLES);
+	if (trace_in) {
+		/* int32_t is int here, so the mapped keys are used in place */
+		sample_keys = (const int *)trace.keys;
+	} else {
+		keys = malloc(sizeof(*keys) * nums);
+		if (workload)
+			gen_workload(keys, nums, workload, reversed);
+		else
+			gen_random(keys, nums, 0);
+		sample_keys = keys;
+	}
+	if (trace_out && trace_save(trace_out, sample_keys, trace.sizes, nums))
+		return 1;
+
+	samples = malloc(sizeof(*samples) * nums);
+	create_sample(&sample_head, samples, sample_keys, nums);
+	offsets = create_offsets(nums, layout, trace.sizes, &bytes);
+	warmdata = malloc(bytes);
+	testdata = malloc(bytes);
 
-	create_sample(&sample_head, samples, nums);
+	if (mode == MODE_COMPACT) {
+		/* The warm-up copy is not needed; reuse it as the arena */
+		bench_compact(tests, &sample_head, testdata, warmdata, nums,
+			      trace.sizes);
+		return 0;
+	}
 
 	while (test->fp != NULL) {
 		printf("==== Testing %s ====\n", test->name);
 		/* Warm up */
 		INIT_LIST_HEAD(&warmdata_head);
 		INIT_LIST_HEAD(&testdata_head);
-		copy_list(&sample_head, &testdata_head, testdata);
-		copy_list(&sample_head, &warmdata_head, warmdata);
+		copy_list(&sample_head, &testdata_head, testdata, offsets);
+		copy_list(&sample_head, &warmdata_head, warmdata, offsets);
 		test->fp(&count, &warmdata_head, compare);
 		/* Test */
-		clock_t begin;
+		uint64_t begin, warm, cold;
 		count = 0;
-		begin = clock();
+		begin = now_ns();
 		test->fp(&count, &testdata_head, compare);
-		printf("  Elapsed time:   %ld\n", clock() - begin);
-		printf("  Comparisons:    %d\n", count);
+		warm = now_ns() - begin;
+		/* Wall-clock microseconds, the unit clock() used to report */
+		printf("  Elapsed time:   %" PRIu64 "\n", warm / 1000);
+		if (test->no_cmp)
+			printf("  Comparisons:    - (not counted)\n");
+		else
+			printf("  Comparisons:    %" PRIu64 "\n", count);
 		printf("  List is %s\n",
-		       check_list(&testdata_head, nums) ? "sorted" : "not sorted");
+		       check_list(&testdata_head, nums, !test->unstable) ? "sorted" : "not sorted");
+		/* The same sort again, starting with the nodes out of cache */
+		if (evict_method != EVICT_NONE) {
+			INIT_LIST_HEAD(&testdata_head);
+			copy_list(&sample_head, &testdata_head, testdata, offsets);
+			evict(evict_method, testdata, bytes, nums);
+			begin = now_ns();
+			test->fp(NULL, &testdata_head, compare);
+			cold = now_ns() - begin;
+			printf("  Cold time:      %" PRIu64 " (%.2fx warm)%s\n",
+			       cold / 1000, (double)cold / warm,
+			       check_list(&testdata_head, nums, !test->unstable) ?
+			       "" : ", not sorted");
+		}
 		test++;
 	}
 
+	trace_close(&trace);
+	free(keys);
 	return 0;
 }
@@ -0,0 +1,358 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Microbenchmarks of the merge kernels, built into their own binary.
+ * The kernels are static, so timsort.c is included rather than linked;
+ * its merge(), merge_final(), build_prev_link() and find_run() are the
+ * same as those of the other engines.
+ */
+#include "timsort.c"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <limits.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#endif
+
+/* Default number of nodes per kernel call */
+#define MICRO_NODES 4096
+/* Fewest nodes per call: the 1:7 split needs a node in each list */
+#define MICRO_MIN_NODES 8
+/* Timed calls per measurement; the median is reported */
+#define MICRO_REPS 101
+/* Default lookahead of the prefetching kernels, in nodes */
+#define MICRO_DISTANCE 4
+/* Buffer walked to evict the nodes where clflush is not available */
+#define EVICT_SIZE ((size_t)256 << 20)
+
+typedef struct element {
+	struct list_head list;
+	int val;
+} element_t;
+
+static int compare(void *priv, const struct list_head *a,
+		   const struct list_head *b)
+{
+	return list_entry(a, element_t, list)->val -
+	       list_entry(b, element_t, list)->val;
+}
+
+/*
+ * Reference cycles where the TSC is available, nanoseconds otherwise.
+ * With a constant-rate TSC the cycles do not follow frequency scaling.
+ */
+static uint64_t cycles(void)
+{
+#ifdef HAVE_TSC
+	return __rdtsc();
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+/* Push @n nodes out of every cache level */
+static void evict(element_t *nodes, size_t n)
+{
+#ifdef HAVE_TSC
+	for (size_t i = 0; i < n; i++)
+		_mm_clflush(&nodes[i]);
+	_mm_mfence();
+#else
+	static volatile char *buf;
+
+	if (!buf)
+		buf = calloc(EVICT_SIZE, 1);
+	for (size_t i = 0; i < EVICT_SIZE; i += 64)
+		buf[i]++;
+#endif
+}
+
+/*
+ * Where node i of an input lives: nodes[i], or with the scattered
+ * layout nodes[slot[i]] for a random permutation slot[], so that
+ * following the sorted order jumps around memory.
+ */
+static size_t *slot;
+
+static element_t *node_at(element_t *nodes, size_t i)
+{
+	return &nodes[slot ? slot[i] : i];
+}
+
+/* Link @n nodes, in the order given by @order, into a null-terminated list */
+static struct list_head *link_nodes(element_t *nodes, const size_t *order,
+				    size_t n)
+{
+	struct list_head *head = NULL, **tail = &head;
+
+	for (size_t i = 0; i < n; i++) {
+		*tail = &node_at(nodes, order[i])->list;
+		tail = &(*tail)->next;
+	}
+	*tail = NULL;
+	return head;
+}
+
+/*
+ * The inputs of one kernel call: nodes[] holds every node, list a is
+ * the first na entries of order[] and list b the remaining nb.
+ */
+struct input {
+	element_t *nodes;
+	size_t *order;
+	size_t na, nb;
+};
+
+/*
+ * Two sorted lists of @n nodes in total, split 1:1 or 1:7.  With
+ * interleaved keys every node goes to a random list, so merge() cannot
+ * predict which side wins; with disjoint keys list a holds the smallest
+ * ones and the merge is one long streak followed by the splice of b.
+ */
+static void make_merge_input(struct input *in, size_t n, bool skewed,
+			     bool interleaved)
+{
+	size_t na = skewed ? n / 8 : n / 2, ia = 0, ib = na;
+
+	for (size_t i = 0; i < n; i++) {
+		bool to_a;
+
+		node_at(in->nodes, i)->val = i;
+		if (!interleaved)
+			to_a = i < na;
+		else
+			to_a = ia < na && (ib == n ||
+					   (size_t)rand() % (n - i) < na - ia);
+		in->order[to_a ? ia++ : ib++] = i;
+	}
+	in->na = na;
+	in->nb = n - na;
+}
+
+/*
+ * One list of @n nodes cut into runs for find_run(): all of 32 nodes,
+ * or alternately 4 and 60 nodes long.  Runs ascend, or strictly descend
+ * so that find_run() also reverses them.  Consecutive runs are separated
+ * by a descent (or an ascent), as natural runs are.
+ */
+static void make_run_input(struct input *in, size_t n, bool skewed,
+			   bool descending)
+{
+	size_t start = 0, k = 0;
+
+	while (start < n) {
+		size_t len = skewed ? (k++ & 1 ? 60 : 4) : 32;
+
+		if (len > n - start)
+			len = n - start;
+		for (size_t i = 0; i < len; i++)
+			node_at(in->nodes, start + i)->val = descending ?
+				(int)(2 * start) - (int)i :
+				(int)i - (int)(2 * start);
+		start += len;
+	}
+	for (size_t i = 0; i < n; i++)
+		in->order[i] = i;
+	in->na = n;
+	in->nb = 0;
+}
+
+enum kernel {
+	K_MERGE,
+	K_MERGE_FINAL,
+	K_BUILD_PREV_LINK,
+	K_FIND_RUN,
+	K_MERGE_PREFETCH,
+	K_MERGE_FINAL_PREFETCH,
+	K_FIND_RUN_PREFETCH,
+};
+
+/* Lookahead given to the prefetching kernels */
+static struct prefetch_hint hint = { 0, MICRO_DISTANCE };
+
+/* Run @kernel once on freshly linked input and return its cost */
+static uint64_t run_kernel(enum kernel kernel, struct input *in, bool cold)
+{
+	struct list_head *a = link_nodes(in->nodes, in->order, in->na);
+	struct list_head *b = link_nodes(in->nodes, in->order + in->na, in->nb);
+	struct list_head head;
+	size_t len;
+	uint64_t begin, end;
+
+	if (cold)
+		evict(in->nodes, in->na + in->nb);
+
+	begin = cycles();
+	switch (kernel) {
+	case K_MERGE:
+		a = merge(NULL, compare, a, b);
+		break;
+	case K_MERGE_FINAL:
+		merge_final(NULL, compare, &head, a, b);
+		break;
+	case K_BUILD_PREV_LINK:
+		build_prev_link(&head, &head, a);
+		break;
+	case K_FIND_RUN:
+		while (a) {
+			struct list_head *run = a;
+
+			a = find_run(NULL, &run, &len, compare);
+		}
+		break;
+	case K_MERGE_PREFETCH:
+		a = merge_prefetch(NULL, compare, a, b, &hint);
+		break;
+	case K_MERGE_FINAL_PREFETCH:
+		merge_final_prefetch(NULL, compare, &head, a, b, &hint);
+		break;
+	case K_FIND_RUN_PREFETCH:
+		while (a) {
+			struct list_head *run = a;
+
+			a = find_run_prefetch(NULL, &run, &len, compare, &hint);
+		}
+		break;
+	}
+	end = cycles();
+
+	__asm__ __volatile__("" : : "r"(a) : "memory");
+	return end - begin;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void measure(const char *kernel_name, enum kernel kernel,
+		    const char *input_name, struct input *in)
+{
+	static uint64_t cost[MICRO_REPS];
+	size_t n = in->na + in->nb;
+
+	for (int cold = 0; cold < 2; cold++) {
+		/* Warm up, so hot runs start with the nodes cached */
+		run_kernel(kernel, in, cold);
+		for (int rep = 0; rep < MICRO_REPS; rep++)
+			cost[rep] = run_kernel(kernel, in, cold);
+		qsort(cost, MICRO_REPS, sizeof(*cost), cmp_u64);
+		printf("%-16s %-24s %-5s %10.2f\n", kernel_name, input_name,
+		       cold ? "cold" : "hot", (double)cost[MICRO_REPS / 2] / n);
+	}
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [-n nodes] [-d distance] [-s]\n"
+		"  -n nodes    nodes per kernel call, at least %d (default %d)\n"
+		"  -d distance lookahead of the prefetching kernels, in nodes\n"
+		"              (default %d)\n"
+		"  -s          scatter the nodes in memory\n",
+		prog, MICRO_MIN_NODES, MICRO_NODES, MICRO_DISTANCE);
+}
+
+int main(int argc, char *argv[])
+{
+	size_t n = MICRO_NODES;
+	bool scattered = false;
+	struct input in;
+	char name[32], *end;
+	long distance;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "d:n:s")) != -1) {
+		switch (opt) {
+		case 'd':
+			distance = strtol(optarg, &end, 0);
+			if (*optarg && !*end && distance >= 0 &&
+			    distance <= INT_MAX) {
+				hint.distance = distance;
+				break;
+			}
+			usage(argv[0]);
+			return 1;
+		case 's':
+			scattered = true;
+			break;
+		case 'n':
+			n = strtoull(optarg, NULL, 0);
+			if (n >= MICRO_MIN_NODES)
+				break;
+			/* fallthrough */
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	srand(1050);
+	in.nodes = malloc(sizeof(*in.nodes) * n);
+	in.order = malloc(sizeof(*in.order) * n);
+	if (scattered) {
+		slot = malloc(sizeof(*slot) * n);
+		for (size_t i = 0; i < n; i++)
+			slot[i] = i;
+		for (size_t i = n - 1; i > 0; i--) {
+			size_t j = rand() % (i + 1), t = slot[i];
+
+			slot[i] = slot[j];
+			slot[j] = t;
+		}
+	}
+
+	printf("%-16s %-24s %-5s %10s\n", "kernel", "input", "cache",
+#ifdef HAVE_TSC
+	       "cycles/node"
+#else
+	       "ns/node"
+#endif
+	       );
+
+	for (int skewed = 0; skewed < 2; skewed++) {
+		for (int interleaved = 1; interleaved >= 0; interleaved--) {
+			make_merge_input(&in, n, skewed, interleaved);
+			snprintf(name, sizeof(name), "%s,%s",
+				 skewed ? "skewed" : "balanced",
+				 interleaved ? "interleaved" : "disjoint");
+			measure("merge", K_MERGE, name, &in);
+			measure("merge_prefetch", K_MERGE_PREFETCH, name, &in);
+			measure("merge_final", K_MERGE_FINAL, name, &in);
+			measure("merge_final_pf", K_MERGE_FINAL_PREFETCH, name,
+				&in);
+		}
+	}
+
+	make_merge_input(&in, n, false, false);
+	in.na = n;
+	in.nb = 0;
+	measure("build_prev_link", K_BUILD_PREV_LINK, "sequential", &in);
+
+	for (int skewed = 0; skewed < 2; skewed++) {
+		for (int descending = 0; descending < 2; descending++) {
+			make_run_input(&in, n, skewed, descending);
+			snprintf(name, sizeof(name), "%s,%s",
+				 skewed ? "skewed" : "balanced",
+				 descending ? "descending" : "ascending");
+			measure("find_run", K_FIND_RUN, name, &in);
+			measure("find_run_pf", K_FIND_RUN_PREFETCH, name, &in);
+		}
+	}
+
+	free(slot);
+	free(in.order);
+	free(in.nodes);
+	return 0;
+}
@@ -1,5 +1,6 @@
 #include "list.h"
 #include "list_sort.h"
+#include "list_sort_trace.h"
 
 #include <stdint.h>
 
@@ -91,12 +92,19 @@ static void merge_final(void *priv, list_cmp_func_t cmp, struct list_head *head,
 	build_prev_link(head, tail, b);
 }
 
-static struct list_head *find_run(void *priv, struct list_head *list,
+/*
+ * Find the run starting at *@head, cut it off as a null-terminated list
+ * and return the remainder of the input.  A strictly descending run is
+ * reversed in place, so *@head is updated to the new first node.
+ */
+static struct list_head *find_run(void *priv, struct list_head **head,
 				  size_t *len, list_cmp_func_t cmp)
 {
-	*len = 1;
+	struct list_head *list = *head;
 	struct list_head *next = list->next;
 
+	*len = 1;
+
 	if (unlikely(next == NULL))
 		return NULL;
 
@@ -111,6 +119,7 @@ static struct list_head *find_run(void *priv, struct list_head *list,
 			next = list->next;
 		} while (next && cmp(priv, list, next) > 0);
 		list->next = prev;
+		*head = list;
 	} else {
 		do {
 			(*len)++;
@@ -125,6 +134,7 @@ static struct list_head *find_run(void *priv, struct list_head *list,
 
 static void merge_at(void *priv, list_cmp_func_t cmp, struct run *at)
 {
+	LIST_SORT_PROBE2(shiverssort, merge, at[0].len, at[1].len);
 	at[0].list = merge(priv, cmp, at[0].list, at[1].list);
 	at[0].len += at[1].len;
 }
@@ -162,6 +172,8 @@ void shiverssort(void *priv, struct list_head *head, list_cmp_func_t cmp)
 	if (head == head->prev)
 		return;
 
+	LIST_SORT_PROBE1(shiverssort, entry, head);
+
 	/* Convert to a null-terminated singly-linked list. */
 	head->prev->next = NULL;
 
@@ -169,7 +181,8 @@ void shiverssort(void *priv, struct list_head *head, list_cmp_func_t cmp)
 		tp++;
 		/* Find next run */
 		tp->list = list;
-		list = find_run(priv, list, &tp->len, cmp);
+		list = find_run(priv, &tp->list, &tp->len, cmp);
+		LIST_SORT_PROBE1(shiverssort, run, tp->len);
 		tp = merge_collapse(priv, cmp, stk, tp);
 	} while (list);
 
@@ -178,8 +191,11 @@ void shiverssort(void *priv, struct list_head *head, list_cmp_func_t cmp)
 
 	/* The final merge; rebuild prev links */
 	if (tp > stk) {
+		LIST_SORT_PROBE2(shiverssort, merge, stk[0].len, stk[1].len);
 		merge_final(priv, cmp, head, stk[0].list, stk[1].list);
 	} else {
 		build_prev_link(head, head, stk->list);
 	}
+	LIST_SORT_PROBE2(shiverssort, exit, head,
+			 tp > stk ? stk[0].len + stk[1].len : stk[0].len);
 }
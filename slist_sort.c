@@ -0,0 +1,102 @@
+// SPDX-License-Identifier: GPL-2.0
+#include "list.h"
+#include "list_sort.h"
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef likely
+# define likely(x)	__builtin_expect(!!(x), 1)
+#endif
+#ifndef unlikely
+# define unlikely(x)	__builtin_expect(!!(x), 0)
+#endif
+
+/* At most two pending sublists per size */
+#define MAX_MERGE_PENDING (2 * sizeof(size_t) * 8)
+
+/*
+ * Same as the list_head merge(): returns a null-terminated list, taking
+ * from @a on ties for stability.
+ */
+static struct slist_node *merge(void *priv, slist_cmp_func_t cmp,
+				struct slist_node *a, struct slist_node *b)
+{
+	struct slist_node *head, **tail = &head;
+
+	for (;;) {
+		/* if equal, take 'a' -- important for sort stability */
+		if (cmp(priv, a, b) <= 0) {
+			*tail = a;
+			tail = &a->next;
+			a = a->next;
+			if (!a) {
+				*tail = b;
+				break;
+			}
+		} else {
+			*tail = b;
+			tail = &b->next;
+			b = b->next;
+			if (!b) {
+				*tail = a;
+				break;
+			}
+		}
+	}
+	return head;
+}
+
+/**
+ * slist_sort - sort a singly-linked list
+ * @priv: private data, opaque to slist_sort(), passed to @cmp
+ * @list: the first node of a null-terminated list, or NULL
+ * @cmp: the elements comparison function
+ *
+ * Returns the first node of the sorted, null-terminated list.  @cmp
+ * follows the list_sort() contract, and the sort is stable.
+ *
+ * The merge schedule is that of list_sort().  There is no prev pointer
+ * to chain the pending sublists through, so they are kept on a small
+ * stack instead, newest on top; a merge removes one entry from the
+ * middle, above which there are at most log2(n) smaller ones to shift.
+ * With no prev links to restore there is no merge_final() pass.
+ */
+struct slist_node *slist_sort(void *priv, struct slist_node *list,
+			      slist_cmp_func_t cmp)
+{
+	struct slist_node *pending[MAX_MERGE_PENDING];
+	size_t count = 0;	/* Count of pending */
+	int top = 0;		/* pending[top - 1] is the newest */
+
+	if (!list || !list->next)	/* Zero or one elements */
+		return list;
+
+	do {
+		size_t bits;
+		int at = top - 1;
+
+		/* Find the least-significant clear bit in count */
+		for (bits = count; bits & 1; bits >>= 1)
+			at--;
+		/* Do the indicated merge */
+		if (likely(bits)) {
+			pending[at - 1] = merge(priv, cmp, pending[at - 1],
+						pending[at]);
+			for (top--; at < top; at++)
+				pending[at] = pending[at + 1];
+		}
+
+		/* Move one element from input list to pending */
+		pending[top++] = list;
+		list = list->next;
+		pending[top - 1]->next = NULL;
+		count++;
+	} while (list);
+
+	/* End of input; merge together all the pending lists. */
+	list = pending[--top];
+	while (top)
+		list = merge(priv, cmp, pending[--top], list);
+	return list;
+}
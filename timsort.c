@@ -1,7 +1,9 @@
 #include "list.h"
 #include "list_sort.h"
+#include "list_sort_trace.h"
 
 #include <stdint.h>
+#include <stddef.h>
 
 #ifndef likely
 #define likely(x) __builtin_expect(!!(x), 1)
@@ -17,6 +19,16 @@ struct run {
 	size_t len;
 };
 
+/*
+ * Tuning of the prefetching kernels: how many nodes ahead of the merge
+ * or the run scan to prefetch, and where the key is relative to the
+ * list_head, so its line can be prefetched too (0: no separate line).
+ */
+struct prefetch_hint {
+	ptrdiff_t key_offset;
+	int distance;
+};
+
 static struct list_head *merge(void *priv, list_cmp_func_t cmp,
 				struct list_head *a, struct list_head *b)
 {
@@ -91,11 +103,165 @@ static void merge_final(void *priv, list_cmp_func_t cmp, struct list_head *head,
 	build_prev_link(head, tail, b);
 }
 
-static struct list_head *find_run(void *priv, struct list_head *list,
+static inline void prefetch_node(const struct list_head *node,
+				 ptrdiff_t key_offset)
+{
+	__builtin_prefetch(node, 1);
+	if (key_offset)
+		__builtin_prefetch((const char *)node + key_offset);
+}
+
+/*
+ * A lookahead pointer runs hint->distance nodes ahead of each list a
+ * kernel walks and prefetches every node it reaches, so the node, and
+ * its key, are in cache when the kernel gets there.  The lookahead
+ * still waits for each ->next, but off the critical path, and for both
+ * lists of a merge at once.
+ */
+static struct list_head *prefetch_start(struct list_head *list,
+					const struct prefetch_hint *hint)
+{
+	for (int i = 0; list && i < hint->distance; i++) {
+		list = list->next;
+		if (list)
+			prefetch_node(list, hint->key_offset);
+	}
+	return list;
+}
+
+static inline struct list_head *prefetch_next(struct list_head *ahead,
+					      ptrdiff_t key_offset)
+{
+	if (ahead) {
+		ahead = ahead->next;
+		if (ahead)
+			prefetch_node(ahead, key_offset);
+	}
+	return ahead;
+}
+
+/* merge(), prefetching ahead in both lists */
+static struct list_head *merge_prefetch(void *priv, list_cmp_func_t cmp,
+					struct list_head *a,
+					struct list_head *b,
+					const struct prefetch_hint *hint)
+{
+	struct list_head *head, **tail = &head;
+	struct list_head *pa = prefetch_start(a, hint);
+	struct list_head *pb = prefetch_start(b, hint);
+
+	for (;;) {
+		/* if equal, take 'a' -- important for sort stability */
+		if (cmp(priv, a, b) <= 0) {
+			*tail = a;
+			tail = &a->next;
+			a = a->next;
+			pa = prefetch_next(pa, hint->key_offset);
+			if (!a) {
+				*tail = b;
+				break;
+			}
+		} else {
+			*tail = b;
+			tail = &b->next;
+			b = b->next;
+			pb = prefetch_next(pb, hint->key_offset);
+			if (!b) {
+				*tail = a;
+				break;
+			}
+		}
+	}
+	return head;
+}
+
+/* merge_final(), prefetching ahead in both lists */
+static void merge_final_prefetch(void *priv, list_cmp_func_t cmp,
+				 struct list_head *head, struct list_head *a,
+				 struct list_head *b,
+				 const struct prefetch_hint *hint)
+{
+	struct list_head *tail = head;
+	struct list_head *pa = prefetch_start(a, hint);
+	struct list_head *pb = prefetch_start(b, hint);
+
+	for (;;) {
+		/* if equal, take 'a' -- important for sort stability */
+		if (cmp(priv, a, b) <= 0) {
+			tail->next = a;
+			a->prev = tail;
+			tail = a;
+			a = a->next;
+			pa = prefetch_next(pa, hint->key_offset);
+			if (!a)
+				break;
+		} else {
+			tail->next = b;
+			b->prev = tail;
+			tail = b;
+			b = b->next;
+			pb = prefetch_next(pb, hint->key_offset);
+			if (!b) {
+				b = a;
+				break;
+			}
+		}
+	}
+
+	/* Finish linking remainder of list b on to tail */
+	build_prev_link(head, tail, b);
+}
+
+/*
+ * Find the run starting at *@head, cut it off as a null-terminated list
+ * and return the remainder of the input.  A strictly descending run is
+ * reversed in place, so *@head is updated to the new first node.
+ */
+static struct list_head *find_run(void *priv, struct list_head **head,
 				  size_t *len, list_cmp_func_t cmp)
 {
+	struct list_head *list = *head;
+	struct list_head *next = list->next;
+
 	*len = 1;
+
+	if (unlikely(next == NULL))
+		return NULL;
+
+	if (cmp(priv, list, next) > 0) {
+		/* decending run, also reverse the list */
+		struct list_head *prev = NULL;
+		do {
+			(*len)++;
+			list->next = prev;
+			prev = list;
+			list = next;
+			next = list->next;
+		} while (next && cmp(priv, list, next) > 0);
+		list->next = prev;
+		*head = list;
+	} else {
+		do {
+			(*len)++;
+			list = next;
+			next = list->next;
+		} while (next && cmp(priv, list, next) <= 0);
+		list->next = NULL;
+	}
+
+	return next;
+}
+
+/* find_run(), prefetching ahead of the scan */
+static struct list_head *find_run_prefetch(void *priv, struct list_head **head,
+					   size_t *len, list_cmp_func_t cmp,
+					   const struct prefetch_hint *hint)
+{
+	struct list_head *list = *head;
 	struct list_head *next = list->next;
+	struct list_head *ahead = prefetch_start(next, hint);
+
+	*len = 1;
 
 	if (unlikely(next == NULL))
 		return NULL;
@@ -109,13 +275,16 @@ static struct list_head *find_run(void *priv, struct list_head *list,
 			prev = list;
 			list = next;
 			next = list->next;
+			ahead = prefetch_next(ahead, hint->key_offset);
 		} while (next && cmp(priv, list, next) > 0);
 		list->next = prev;
+		*head = list;
 	} else {
 		do {
 			(*len)++;
 			list = next;
 			next = list->next;
+			ahead = prefetch_next(ahead, hint->key_offset);
 		} while (next && cmp(priv, list, next) <= 0);
 		list->next = NULL;
 	}
@@ -123,42 +292,49 @@ static struct list_head *find_run(void *priv, struct list_head *list,
 	return next;
 }
 
-static void merge_at(void *priv, list_cmp_func_t cmp, struct run *at)
+static inline __attribute__((always_inline)) void
+merge_at(void *priv, list_cmp_func_t cmp, struct run *at,
+	 const struct prefetch_hint *hint)
 {
-	at[0].list = merge(priv, cmp, at[0].list, at[1].list);
+	LIST_SORT_PROBE2(timsort, merge, at[0].len, at[1].len);
+	at[0].list = hint ? merge_prefetch(priv, cmp, at[0].list, at[1].list,
+					   hint) :
+			    merge(priv, cmp, at[0].list, at[1].list);
 	at[0].len += at[1].len;
 }
 
-static struct run *merge_force_collapse(void *priv, list_cmp_func_t cmp,
-					struct run *stk, struct run *tp)
+static inline __attribute__((always_inline)) struct run *
+merge_force_collapse(void *priv, list_cmp_func_t cmp, struct run *stk,
+		     struct run *tp, const struct prefetch_hint *hint)
 {
 	while ((tp - stk + 1) >= 3) {
 		if (tp[-2].len < tp[0].len) {
-			merge_at(priv, cmp, &tp[-2]);
+			merge_at(priv, cmp, &tp[-2], hint);
 			tp[-1] = tp[0];
 		} else {
-			merge_at(priv, cmp, &tp[-1]);
+			merge_at(priv, cmp, &tp[-1], hint);
 		}
 		tp--;
 	}
 	return tp;
 }
 
-static struct run *merge_collapse(void *priv, list_cmp_func_t cmp,
-				  struct run *stk, struct run *tp)
+static inline __attribute__((always_inline)) struct run *
+merge_collapse(void *priv, list_cmp_func_t cmp, struct run *stk,
+	       struct run *tp, const struct prefetch_hint *hint)
 {
 	int n;
 	while ((n = tp - stk + 1) >= 2) {
 		if ((n >= 3 && tp[-2].len <= tp[-1].len + tp[0].len) ||
 		    (n >= 4 && tp[-3].len <= tp[-2].len + tp[-1].len)) {
 			if (tp[-2].len < tp[0].len) {
-				merge_at(priv, cmp, &tp[-2]);
+				merge_at(priv, cmp, &tp[-2], hint);
 				tp[-1] = tp[0];
 			} else {
-				merge_at(priv, cmp, &tp[-1]);
+				merge_at(priv, cmp, &tp[-1], hint);
 			}
 		} else if (tp[-1].len <= tp[0].len) {
-			merge_at(priv, cmp, &tp[-1]);
+			merge_at(priv, cmp, &tp[-1], hint);
 		} else {
 			break;
 		}
@@ -168,7 +344,14 @@ static struct run *merge_collapse(void *priv, list_cmp_func_t cmp,
 	return tp;
 }
 
-void timsort(void *priv, struct list_head *head, list_cmp_func_t cmp)
+/*
+ * timsort(), with the prefetching kernels if @hint is given.  It and the
+ * helpers above that take @hint are always inlined, so the NULL @hint
+ * of timsort() folds away and the reference engine tests nothing extra.
+ */
+static inline __attribute__((always_inline)) void
+timsort_hint(void *priv, struct list_head *head, list_cmp_func_t cmp,
+	     const struct prefetch_hint *hint)
 {
 	struct list_head *list = head->next;
 	struct run stk[MAX_MERGE_PENDING], *tp = stk - 1;
@@ -176,6 +359,8 @@ void timsort(void *priv, struct list_head *head, list_cmp_func_t cmp)
 	if (head == head->prev)
 		return;
 
+	LIST_SORT_PROBE1(timsort, entry, head);
+
 	/* Convert to a null-terminated singly-linked list. */
 	head->prev->next = NULL;
 
@@ -183,17 +368,55 @@ void timsort(void *priv, struct list_head *head, list_cmp_func_t cmp)
 		tp++;
 		/* Find next run */
 		tp->list = list;
-		list = find_run(priv, list, &tp->len, cmp);
-		tp = merge_collapse(priv, cmp, stk, tp);
+		list = hint ? find_run_prefetch(priv, &tp->list, &tp->len, cmp,
+						hint) :
+			      find_run(priv, &tp->list, &tp->len, cmp);
+		LIST_SORT_PROBE1(timsort, run, tp->len);
+		tp = merge_collapse(priv, cmp, stk, tp, hint);
 	} while (list);
 
 	/* End of input; merge together all the runs. */
-	tp = merge_force_collapse(priv, cmp, stk, tp);
+	tp = merge_force_collapse(priv, cmp, stk, tp, hint);
 
 	/* The final merge; rebuild prev links */
 	if (tp > stk) {
-		merge_final(priv, cmp, head, stk[0].list, stk[1].list);
+		LIST_SORT_PROBE2(timsort, merge, stk[0].len, stk[1].len);
+		if (hint)
+			merge_final_prefetch(priv, cmp, head, stk[0].list,
+					     stk[1].list, hint);
+		else
+			merge_final(priv, cmp, head, stk[0].list, stk[1].list);
 	} else {
 		build_prev_link(head, head, stk->list);
 	}
+	LIST_SORT_PROBE2(timsort, exit, head,
+			 tp > stk ? stk[0].len + stk[1].len : stk[0].len);
+}
+
+void timsort(void *priv, struct list_head *head, list_cmp_func_t cmp)
+{
+	timsort_hint(priv, head, cmp, NULL);
+}
+
+/**
+ * timsort_prefetch - timsort() with software prefetching
+ * @priv: private data, opaque to timsort_prefetch(), passed to @cmp
+ * @head: the list to sort
+ * @cmp: the elements comparison function
+ * @key_offset: where @cmp finds the key, in bytes from the list_head,
+ *	or 0 if it is on the same cache line
+ * @distance: how many nodes ahead to prefetch
+ *
+ * Same result as timsort().  merge(), merge_final() and find_run() are
+ * replaced by variants that keep a pointer @distance nodes ahead in
+ * every list they walk and prefetch the node there, and its key if
+ * @key_offset is given.  That helps when the nodes are scattered and
+ * not cached; on nodes already in cache it only adds instructions.
+ */
+void timsort_prefetch(void *priv, struct list_head *head, list_cmp_func_t cmp,
+		      ptrdiff_t key_offset, int distance)
+{
+	struct prefetch_hint hint = { key_offset, distance };
+
+	timsort_hint(priv, head, cmp, &hint);
 }
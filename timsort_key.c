@@ -0,0 +1,460 @@
+// SPDX-License-Identifier: GPL-2.0
+#include "list.h"
+#include "list_sort.h"
+
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_SIMD 1
+#endif
+
+#ifndef likely
+#define likely(x) __builtin_expect(!!(x), 1)
+#endif
+#ifndef unlikely
+#define unlikely(x) __builtin_expect(!!(x), 0)
+#endif
+
+#define MAX_MERGE_PENDING 85
+
+/* Nodes sorted together by the network, and blocks gathered at once */
+#define BLOCK 8
+#define GROUP (4 * BLOCK)
+
+#define KEY(node, off) (*(const int *)((const char *)(node) + (off)))
+
+struct run {
+	struct list_head *list;
+	size_t len;
+};
+
+/* The run being grown from consecutive sorted blocks */
+struct block_run {
+	struct list_head *head, *tail;
+	size_t len;
+	int first, last;
+};
+
+static struct list_head *merge(ptrdiff_t off, struct list_head *a,
+				struct list_head *b)
+{
+	struct list_head *head, **tail = &head;
+
+	for (;;) {
+		/* if equal, take 'a' -- important for sort stability */
+		if (KEY(a, off) <= KEY(b, off)) {
+			*tail = a;
+			tail = &a->next;
+			a = a->next;
+			if (!a) {
+				*tail = b;
+				break;
+			}
+		} else {
+			*tail = b;
+			tail = &b->next;
+			b = b->next;
+			if (!b) {
+				*tail = a;
+				break;
+			}
+		}
+	}
+	return head;
+}
+
+static void build_prev_link(struct list_head *head, struct list_head *tail,
+			    struct list_head *list)
+{
+	tail->next = list;
+	do {
+		list->prev = tail;
+		tail = list;
+		list = list->next;
+	} while (list);
+
+	/* The final links to make a circular doubly-linked list */
+	tail->next = head;
+	head->prev = tail;
+}
+
+static void merge_final(ptrdiff_t off, struct list_head *head,
+			struct list_head *a, struct list_head *b)
+{
+	struct list_head *tail = head;
+
+	for (;;) {
+		/* if equal, take 'a' -- important for sort stability */
+		if (KEY(a, off) <= KEY(b, off)) {
+			tail->next = a;
+			a->prev = tail;
+			tail = a;
+			a = a->next;
+			if (!a)
+				break;
+		} else {
+			tail->next = b;
+			b->prev = tail;
+			tail = b;
+			b = b->next;
+			if (!b) {
+				b = a;
+				break;
+			}
+		}
+	}
+
+	/* Finish linking remainder of list b on to tail */
+	build_prev_link(head, tail, b);
+}
+
+static void merge_at(ptrdiff_t off, struct run *at)
+{
+	at[0].list = merge(off, at[0].list, at[1].list);
+	at[0].len += at[1].len;
+}
+
+static struct run *merge_force_collapse(ptrdiff_t off, struct run *stk,
+					struct run *tp)
+{
+	while ((tp - stk + 1) >= 3) {
+		if (tp[-2].len < tp[0].len) {
+			merge_at(off, &tp[-2]);
+			tp[-1] = tp[0];
+		} else {
+			merge_at(off, &tp[-1]);
+		}
+		tp--;
+	}
+	return tp;
+}
+
+static struct run *merge_collapse(ptrdiff_t off, struct run *stk,
+				  struct run *tp)
+{
+	int n;
+	while ((n = tp - stk + 1) >= 2) {
+		if ((n >= 3 && tp[-2].len <= tp[-1].len + tp[0].len) ||
+		    (n >= 4 && tp[-3].len <= tp[-2].len + tp[-1].len)) {
+			if (tp[-2].len < tp[0].len) {
+				merge_at(off, &tp[-2]);
+				tp[-1] = tp[0];
+			} else {
+				merge_at(off, &tp[-1]);
+			}
+		} else if (tp[-1].len <= tp[0].len) {
+			merge_at(off, &tp[-1]);
+		} else {
+			break;
+		}
+		tp--;
+	}
+
+	return tp;
+}
+
+/*
+ * The optimal 19-comparator network for 8 inputs.  Every key is made
+ * unique by its position in the low bits, so the network is stable.
+ */
+#define SORT8(CAS, r)							\
+	do {								\
+		CAS(r[0], r[2]); CAS(r[1], r[3]);			\
+		CAS(r[4], r[6]); CAS(r[5], r[7]);			\
+		CAS(r[0], r[4]); CAS(r[1], r[5]);			\
+		CAS(r[2], r[6]); CAS(r[3], r[7]);			\
+		CAS(r[0], r[1]); CAS(r[2], r[3]);			\
+		CAS(r[4], r[5]); CAS(r[6], r[7]);			\
+		CAS(r[2], r[4]); CAS(r[3], r[5]);			\
+		CAS(r[1], r[4]); CAS(r[3], r[6]);			\
+		CAS(r[1], r[2]); CAS(r[3], r[4]); CAS(r[5], r[6]);	\
+	} while (0)
+
+#define CAS_SCALAR(a, b)						\
+	do {								\
+		int64_t __lo = (a) < (b) ? (a) : (b);			\
+		(b) = (a) < (b) ? (b) : (a);				\
+		(a) = __lo;						\
+	} while (0)
+
+#ifdef HAVE_SIMD
+#define CAS_SSE42(a, b)							\
+	do {								\
+		__m128i __gt = _mm_cmpgt_epi64((a), (b));		\
+		__m128i __lo = _mm_blendv_epi8((a), (b), __gt);		\
+		(b) = _mm_blendv_epi8((b), (a), __gt);			\
+		(a) = __lo;						\
+	} while (0)
+
+#define CAS_AVX2(a, b)							\
+	do {								\
+		__m256i __gt = _mm256_cmpgt_epi64((a), (b));		\
+		__m256i __lo = _mm256_blendv_epi8((a), (b), __gt);	\
+		(b) = _mm256_blendv_epi8((b), (a), __gt);		\
+		(a) = __lo;						\
+	} while (0)
+#endif
+
+/*
+ * Bit i is set if keys[i] > keys[i + 1].  keys[GROUP] must repeat
+ * keys[GROUP - 1], so that the last bit is always clear.
+ */
+static uint32_t descents_scalar(const int *keys)
+{
+	uint32_t mask = 0;
+
+	for (int i = 0; i < GROUP - 1; i++)
+		mask |= (uint32_t)(keys[i] > keys[i + 1]) << i;
+	return mask;
+}
+
+#ifdef HAVE_SIMD
+__attribute__((target("sse4.2")))
+static uint32_t descents_sse42(const int *keys)
+{
+	uint32_t mask = 0;
+
+	for (int i = 0; i < GROUP; i += 4) {
+		__m128i a = _mm_loadu_si128((const __m128i *)(keys + i));
+		__m128i b = _mm_loadu_si128((const __m128i *)(keys + i + 1));
+
+		mask |= (uint32_t)_mm_movemask_ps(
+				_mm_castsi128_ps(_mm_cmpgt_epi32(a, b))) << i;
+	}
+	return mask;
+}
+
+__attribute__((target("avx2")))
+static uint32_t descents_avx2(const int *keys)
+{
+	uint32_t mask = 0;
+
+	for (int i = 0; i < GROUP; i += 8) {
+		__m256i a = _mm256_loadu_si256((const __m256i *)(keys + i));
+		__m256i b = _mm256_loadu_si256((const __m256i *)(keys + i + 1));
+
+		mask |= (uint32_t)_mm256_movemask_ps(
+				_mm256_castsi256_ps(_mm256_cmpgt_epi32(a, b))) << i;
+	}
+	return mask;
+}
+#endif
+
+/* Sort each of the four blocks of @blk */
+static void sort_blocks_scalar(int64_t blk[4][BLOCK])
+{
+	for (int b = 0; b < 4; b++)
+		SORT8(CAS_SCALAR, blk[b]);
+}
+
+#ifdef HAVE_SIMD
+/* Two blocks at a time, lane b of register i holding blk[b][i] */
+__attribute__((target("sse4.2")))
+static void sort_blocks_sse42(int64_t blk[4][BLOCK])
+{
+	for (int b = 0; b < 4; b += 2) {
+		__m128i r[BLOCK];
+		int64_t out[2];
+
+		for (int i = 0; i < BLOCK; i++)
+			r[i] = _mm_set_epi64x(blk[b + 1][i], blk[b][i]);
+		SORT8(CAS_SSE42, r);
+		/* Through memory: _mm_extract_epi64() is x86-64 only */
+		for (int i = 0; i < BLOCK; i++) {
+			_mm_storeu_si128((__m128i *)out, r[i]);
+			blk[b][i] = out[0];
+			blk[b + 1][i] = out[1];
+		}
+	}
+}
+
+/* All four blocks at once, lane b of register i holding blk[b][i] */
+__attribute__((target("avx2")))
+static void sort_blocks_avx2(int64_t blk[4][BLOCK])
+{
+	__m256i r[BLOCK];
+	int64_t out[4];
+
+	for (int i = 0; i < BLOCK; i++)
+		r[i] = _mm256_set_epi64x(blk[3][i], blk[2][i], blk[1][i],
+					 blk[0][i]);
+	SORT8(CAS_AVX2, r);
+	for (int i = 0; i < BLOCK; i++) {
+		_mm256_storeu_si256((__m256i *)out, r[i]);
+		for (int b = 0; b < 4; b++)
+			blk[b][i] = out[b];
+	}
+}
+#endif
+
+struct simd_ops {
+	uint32_t (*descents)(const int *keys);
+	void (*sort_blocks)(int64_t blk[4][BLOCK]);
+};
+
+static const struct simd_ops simd_scalar = { descents_scalar,
+					     sort_blocks_scalar };
+#ifdef HAVE_SIMD
+static const struct simd_ops simd_avx2 = { descents_avx2, sort_blocks_avx2 },
+			     simd_sse42 = { descents_sse42, sort_blocks_sse42 };
+#endif
+
+static const struct simd_ops *simd_ops(void)
+{
+#ifdef HAVE_SIMD
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		return &simd_avx2;
+	if (__builtin_cpu_supports("sse4.2"))
+		return &simd_sse42;
+#endif
+	return &simd_scalar;
+}
+
+/*
+ * Append a sorted null-terminated block to the run being grown, or put
+ * it in front if all of it is strictly smaller.  Otherwise the run is
+ * finished: push it on the stack and start a new one with the block.
+ */
+static struct run *add_block(ptrdiff_t off, struct run *stk, struct run *tp,
+			     struct block_run *cur, struct list_head *head,
+			     struct list_head *tail, size_t len)
+{
+	int first = KEY(head, off), last = KEY(tail, off);
+
+	if (likely(cur->len)) {
+		if (cur->last <= first) {
+			cur->tail->next = head;
+			cur->tail = tail;
+			cur->last = last;
+			cur->len += len;
+			return tp;
+		}
+		if (last < cur->first) {
+			tail->next = cur->head;
+			cur->head = head;
+			cur->first = first;
+			cur->len += len;
+			return tp;
+		}
+		tp++;
+		tp->list = cur->head;
+		tp->len = cur->len;
+		tp = merge_collapse(off, stk, tp);
+	}
+
+	*cur = (struct block_run){ head, tail, len, first, last };
+	return tp;
+}
+
+/* Link @nodes in the order given by the positions in the sorted @c */
+static struct list_head *link_sorted(struct list_head **nodes,
+				     const int64_t *c, int len, int mask)
+{
+	for (int i = 0; i < len - 1; i++)
+		nodes[c[i] & mask]->next = nodes[c[i + 1] & mask];
+	nodes[c[len - 1] & mask]->next = NULL;
+	return nodes[c[len - 1] & mask];
+}
+
+/**
+ * timsort_key - sort a list by an int key, using SIMD where available
+ * @head: the list to sort
+ * @key_offset: offset of the int key from each struct list_head
+ *
+ * A stable, ascending sort like timsort(), but for lists whose order is
+ * a plain int key at a fixed offset from the list node, so that keys can
+ * be compared without calling back into the user.
+ *
+ * The input is consumed GROUP nodes at a time.  Their keys are gathered
+ * into an array and scanned for descents with AVX2 or SSE4.2 compares
+ * and movemask.  A group without descents is already linked in order
+ * and is taken as is.  Otherwise it is cut into four blocks of BLOCK
+ * nodes, which are sorted side by side with a sorting network on
+ * (key, position) pairs, one block per vector lane, and relinked.
+ * Consecutive blocks that continue each other, ascending or strictly
+ * descending, are joined into one run, so natural runs survive; the
+ * runs are merged with timsort()'s stack rules.  The instruction set is
+ * picked at run time; plain C is used on CPUs without SSE4.2 and on
+ * other architectures.
+ */
+void timsort_key(struct list_head *head, ptrdiff_t key_offset)
+{
+	const struct simd_ops *ops = simd_ops();
+	struct list_head *list = head->next;
+	struct run stk[MAX_MERGE_PENDING], *tp = stk - 1;
+	struct block_run cur = { .len = 0 };
+	ptrdiff_t off = key_offset;
+
+	if (head == head->prev)
+		return;
+
+	/* Convert to a null-terminated singly-linked list. */
+	head->prev->next = NULL;
+
+	do {
+		struct list_head *nodes[GROUP];
+		int keys[GROUP + 1];
+		int64_t blk[4][BLOCK];
+		int m;
+
+		for (m = 0; m < GROUP && list; m++, list = list->next) {
+			nodes[m] = list;
+			keys[m] = KEY(list, off);
+		}
+
+		if (unlikely(m < GROUP)) {
+			/* The tail of the input: insertion sort, one block */
+			int64_t *c = blk[0];
+
+			for (int i = 0; i < m; i++) {
+				int64_t x = (int64_t)keys[i] * GROUP + i;
+				int j = i;
+
+				for (; j > 0 && c[j - 1] > x; j--)
+					c[j] = c[j - 1];
+				c[j] = x;
+			}
+			tp = add_block(off, stk, tp, &cur, nodes[c[0] & (GROUP - 1)],
+				       link_sorted(nodes, c, m, GROUP - 1), m);
+			break;
+		}
+
+		keys[GROUP] = keys[GROUP - 1];	/* see descents_scalar() */
+		if (!ops->descents(keys)) {
+			/* Already ascending and linked in order */
+			nodes[GROUP - 1]->next = NULL;
+			tp = add_block(off, stk, tp, &cur, nodes[0],
+				       nodes[GROUP - 1], GROUP);
+			continue;
+		}
+
+		for (int b = 0; b < 4; b++)
+			for (int i = 0; i < BLOCK; i++)
+				blk[b][i] = (int64_t)keys[b * BLOCK + i] * GROUP +
+					    b * BLOCK + i;
+		ops->sort_blocks(blk);
+		for (int b = 0; b < 4; b++)
+			tp = add_block(off, stk, tp, &cur,
+				       nodes[blk[b][0] & (GROUP - 1)],
+				       link_sorted(nodes, blk[b], BLOCK,
+						   GROUP - 1),
+				       BLOCK);
+	} while (list);
+
+	tp++;
+	tp->list = cur.head;
+	tp->len = cur.len;
+
+	/* End of input; merge together all the runs. */
+	tp = merge_collapse(off, stk, tp);
+	tp = merge_force_collapse(off, stk, tp);
+
+	/* The final merge; rebuild prev links */
+	if (tp > stk) {
+		merge_final(off, head, stk[0].list, stk[1].list);
+	} else {
+		build_prev_link(head, head, stk->list);
+	}
+}